@@ -0,0 +1,121 @@
+#pragma once
+
+#ifndef SYNTHETIC_VOLUMES_H
+#define SYNTHETIC_VOLUMES_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// Reproducible synthetic segmentations for the benchmark and the tests.
+//
+// All generators return labels in [1, maxLabel] for the objects and 0 for
+// background, and fill `segments` with the labels that should be meshed.
+// `maxLabel` keeps uint8 volumes within range.
+
+template<typename T>
+static void FillBall(std::vector<T> & volume, size_t n, double cx, double cy, double cz, double r, T label) {
+  const long x0 = std::max(0L, long(cx - r)), x1 = std::min(long(n) - 1, long(cx + r) + 1);
+  const long y0 = std::max(0L, long(cy - r)), y1 = std::min(long(n) - 1, long(cy + r) + 1);
+  const long z0 = std::max(0L, long(cz - r)), z1 = std::min(long(n) - 1, long(cz + r) + 1);
+  for (long z = z0; z <= z1; ++z) {
+    for (long y = y0; y <= y1; ++y) {
+      for (long x = x0; x <= x1; ++x) {
+        const double dx = x - cx, dy = y - cy, dz = z - cz;
+        if (dx * dx + dy * dy + dz * dz <= r * r) {
+          volume[x + n * (y + n * z)] = label;
+        }
+      }
+    }
+  }
+}
+
+// A handful of large overlapping spheres, half of them selected
+template<typename T>
+static void GenerateSpheres(std::vector<T> & volume, size_t n, std::mt19937_64 & rng, T maxLabel, std::vector<T> & segments) {
+  std::uniform_real_distribution<double> pos(0.2 * n, 0.8 * n), radius(0.05 * n, 0.2 * n);
+  const T count = std::min<T>(16, maxLabel);
+  for (T label = 1; label <= count; ++label) {
+    FillBall<T>(volume, n, pos(rng), pos(rng), pos(rng), radius(rng), label);
+    if (label % 2) segments.push_back(label);
+  }
+}
+
+// Random walk tubes with varying radius, like neurite fragments crossing a task
+template<typename T>
+static void GenerateNeurites(std::vector<T> & volume, size_t n, std::mt19937_64 & rng, T maxLabel, std::vector<T> & segments) {
+  std::uniform_real_distribution<double> pos(0.0, double(n)), turn(-0.3, 0.3), radius(2.0, 6.0);
+  const T count = std::min<T>(32, maxLabel);
+  for (T label = 1; label <= count; ++label) {
+    double p[3] = { pos(rng), pos(rng), pos(rng) };
+    double d[3] = { turn(rng), turn(rng), 1.0 };
+    const double r = radius(rng);
+    for (size_t step = 0; step < 2 * n; ++step) {
+      FillBall<T>(volume, n, p[0], p[1], p[2], r, label);
+      double len = 0.0;
+      for (int i = 0; i < 3; ++i) {
+        d[i] += turn(rng) * 0.2;
+        len += d[i] * d[i];
+      }
+      len = std::sqrt(len);
+      for (int i = 0; i < 3; ++i) {
+        d[i] /= len;
+        p[i] += d[i] * r * 0.5;
+      }
+      if (p[0] < 0 || p[1] < 0 || p[2] < 0 || p[0] >= n || p[1] >= n || p[2] >= n) break;
+    }
+    if (label % 4 == 1) segments.push_back(label);
+  }
+}
+
+// Many small blobs with distinct labels, most of them selected (large segment sets)
+template<typename T>
+static void GenerateFragments(std::vector<T> & volume, size_t n, std::mt19937_64 & rng, T maxLabel, std::vector<T> & segments) {
+  std::uniform_real_distribution<double> pos(0.0, double(n)), radius(1.0, 3.0);
+  const size_t count = n * n / 16;
+  for (size_t i = 0; i < count; ++i) {
+    const T label = static_cast<T>(1 + i % maxLabel);
+    FillBall<T>(volume, n, pos(rng), pos(rng), pos(rng), radius(rng), label);
+  }
+  const size_t selected = std::min<size_t>(count, std::min<size_t>(maxLabel, 1000));
+  for (size_t i = 0; i < selected; i += 4) {
+    segments.push_back(static_cast<T>(1 + i));
+  }
+}
+
+// Every other voxel selected, the worst case for marching cubes and welding
+template<typename T>
+static void GenerateCheckerboard(std::vector<T> & volume, size_t n, std::vector<T> & segments) {
+  for (size_t z = 0; z < n; ++z) {
+    for (size_t y = 0; y < n; ++y) {
+      for (size_t x = 0; x < n; ++x) {
+        volume[x + n * (y + n * z)] = static_cast<T>(1 + (x + y + z) % 2);
+      }
+    }
+  }
+  segments.push_back(1);
+}
+
+template<typename T>
+static std::vector<T> GenerateVolume(const std::string & shape, size_t n, uint64_t seed, std::vector<T> & segments) {
+  std::vector<T> volume(n * n * n, 0);
+  std::mt19937_64 rng(seed);
+  const T maxLabel = static_cast<T>(std::min<uint64_t>(std::numeric_limits<T>::max(), 100000));
+
+  if (shape == "spheres") {
+    GenerateSpheres<T>(volume, n, rng, maxLabel, segments);
+  } else if (shape == "neurites") {
+    GenerateNeurites<T>(volume, n, rng, maxLabel, segments);
+  } else if (shape == "fragments") {
+    GenerateFragments<T>(volume, n, rng, maxLabel, segments);
+  } else {
+    GenerateCheckerboard<T>(volume, n, segments);
+  }
+  return volume;
+}
+
+#endif
@@ -0,0 +1,249 @@
+// Benchmark harness for the task mesher.
+//
+// Generates reproducible synthetic segmentations, runs every meshing stage on
+// them and prints one JSON object per case to stdout (JSON lines). Each case
+// runs in a forked child, so peak_rss_kb is the high-water mark of that case
+// alone.
+//
+//   bench_taskmesher [--shapes spheres,neurites,fragments,checkerboard]
+//                    [--sizes 128,256,512] [--types uint8,uint16,uint32]
+//                    [--mips 4] [--threads 1] [--seed 1]
+
+#include "TaskMesher.h"
+#include "SyntheticVolumes.h"
+
+#include <zi/mesh/marching_cubes.hpp>
+#include <zi/timer.hpp>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*****************************************************************/
+
+struct CBenchCase {
+  std::string shape;
+  std::string type;
+  size_t      size;
+};
+
+struct CBenchConfig {
+  std::vector<std::string> shapes;
+  std::vector<std::string> types;
+  std::vector<size_t>      sizes;
+  uint8_t                  mips;
+  size_t                   threads;
+  uint64_t                 seed;
+};
+
+/*****************************************************************/
+
+static std::vector<std::string> SplitList(const std::string & list) {
+  std::vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+static long PeakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/*****************************************************************/
+
+/*****************************************************************/
+
+// Runs the pipeline of CTaskMesher stage by stage (single threaded) and then
+// the mesher itself end to end with the configured options.
+template<typename T>
+static void RunCase(const CBenchCase & c, const CBenchConfig & config) {
+  std::ostringstream json;
+  zi::wall_timer t;
+
+  std::vector<T> segments;
+  std::vector<T> volume = GenerateVolume<T>(c.shape, c.size, config.seed, segments);
+  const zi::vl::vec<size_t, 3> dim(c.size, c.size, c.size);
+
+  json << "{\"shape\":\"" << c.shape << "\",\"type\":\"" << c.type << "\",\"size\":" << c.size
+       << ",\"segments\":" << segments.size() << ",\"mips\":" << int(config.mips)
+       << ",\"threads\":" << config.threads << ",\"stages\":{";
+
+  // Mask
+  t.reset();
+  CSegmentMask<T> lookup(std::set<T>(segments.begin(), segments.end()));
+  zi::vl::vec<size_t, 3> bboxMin(dim), bboxMax(0, 0, 0), origin, extent;
+  const size_t selected = lookup.bounds(volume.data(), dim, bboxMin, bboxMax);
+  std::vector<uint8_t> mask;
+  if (selected > 0) {
+    for (int i = 0; i < 3; ++i) {
+      origin[i] = bboxMin[i] > 0 ? bboxMin[i] - 1 : 0;
+      extent[i] = std::min(bboxMax[i] + 2, dim[i]) - origin[i];
+    }
+    mask.resize(extent[0] * extent[1] * extent[2]);
+    lookup.extract(volume.data(), dim, origin, extent, &mask[0]);
+  }
+  json << "\"mask\":" << t.elapsed<double>();
+
+  // Marching cubes
+  t.reset();
+  zi::mesh::int_mesh im;
+  size_t mcTriangles = 0;
+  if (!mask.empty()) {
+    zi::mesh::marching_cubes<uint8_t> mc;
+    mc.marche(&mask[0], extent[2], extent[1], extent[0]);
+    if (mc.count(1) > 0) {
+      MCTriangles<uint8_t> triangles = mc.get_triangles(1);
+      json << ",\"marching_cubes\":" << t.elapsed<double>();
+
+      t.reset();
+      TranslateTriangles(triangles, origin[2], origin[1], origin[0]);
+      im.add(triangles);
+      mcTriangles = triangles.size();
+      json << ",\"int_mesh\":" << t.elapsed<double>();
+    }
+  }
+  std::vector<uint8_t>().swap(mask);
+
+  std::ostringstream lods;
+  if (mcTriangles > 0) {
+    zi::mesh::simplifier<double> s;
+
+    t.reset();
+    im.fill_simplifier<double>(s);
+    json << ",\"fill_simplifier\":" << t.elapsed<double>();
+
+    t.reset();
+    s.prepare();
+    json << ",\"prepare\":" << t.elapsed<double>();
+
+    for (int lod = 0; lod <= config.mips; ++lod) {
+      double optimize = 0.0;
+      if (lod > 0) {
+        size_t targetFaces;
+        double maxError;
+        LodSchedule(lod - 1, s.face_count(), targetFaces, maxError);
+        t.reset();
+        s.optimize(targetFaces, maxError);
+        optimize = t.elapsed<double>();
+      }
+
+      std::vector<zi::vl::vec3d> points, normals;
+      std::vector<uint32_t> indices, starts, lengths;
+      t.reset();
+      s.stripify(points, normals, indices, starts, lengths);
+      const double stripify = t.elapsed<double>();
+
+      t.reset();
+      CVertexArrays vertices;
+      ToVertexArrays(vertices, points, normals);
+      std::vector<float> strip;
+      tri_strip_to_degenerate(strip, vertices, indices, starts, lengths);
+      const double serialize = t.elapsed<double>();
+
+      t.reset();
+      const std::vector<char> indexed = CreateIndexedMesh(s);
+      const double serializeIndexed = t.elapsed<double>();
+
+      lods << (lod > 0 ? "," : "") << "{\"lod\":" << lod << ",\"faces\":" << s.face_count()
+           << ",\"vertices\":" << points.size() << ",\"optimize\":" << optimize
+           << ",\"stripify\":" << stripify << ",\"serialize_strip\":" << serialize
+           << ",\"serialize_indexed\":" << serializeIndexed
+           << ",\"strip_bytes\":" << strip.size() * sizeof(float) << ",\"indexed_bytes\":" << indexed.size() << "}";
+    }
+  }
+  im = zi::mesh::int_mesh();
+
+  // End to end
+  CTaskMesherOptions options;
+  options.threadCount = config.threads;
+  t.reset();
+  {
+    CTaskMesher<T> mesher(volume.data(), dim, segments, config.mips, options);
+  }
+  const double total = t.elapsed<double>();
+
+  json << ",\"total\":" << total << "},\"voxels_selected\":" << selected
+       << ",\"mc_triangles\":" << mcTriangles << ",\"lods\":[" << lods.str() << "]"
+       << ",\"peak_rss_kb\":" << PeakRssKb() << "}";
+
+  printf("%s\n", json.str().c_str());
+  fflush(stdout);
+}
+
+/*****************************************************************/
+
+static int RunForked(const CBenchCase & c, const CBenchConfig & config) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    if (c.type == "uint8") RunCase<uint8_t>(c, config);
+    else if (c.type == "uint16") RunCase<uint16_t>(c, config);
+    else RunCase<uint32_t>(c, config);
+    _exit(0);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("{\"shape\":\"%s\",\"type\":\"%s\",\"size\":%zu,\"error\":\"child failed (status %d)\"}\n",
+           c.shape.c_str(), c.type.c_str(), c.size, status);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char ** argv) {
+  CBenchConfig config;
+  config.shapes = SplitList("spheres,neurites,fragments,checkerboard");
+  config.types = SplitList("uint8,uint16,uint32");
+  config.sizes = { 128, 256, 512 };
+  config.mips = 4;
+  config.threads = 1;
+  config.seed = 1;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i], value = argv[i + 1];
+    if (arg == "--shapes") {
+      config.shapes = SplitList(value);
+    } else if (arg == "--types") {
+      config.types = SplitList(value);
+    } else if (arg == "--sizes") {
+      config.sizes.clear();
+      for (const std::string & size : SplitList(value)) config.sizes.push_back(std::stoul(size));
+    } else if (arg == "--mips") {
+      config.mips = static_cast<uint8_t>(std::stoul(value));
+    } else if (arg == "--threads") {
+      config.threads = std::stoul(value);
+    } else if (arg == "--seed") {
+      config.seed = std::stoull(value);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  int failures = 0;
+  for (size_t size : config.sizes) {
+    for (const std::string & shape : config.shapes) {
+      for (const std::string & type : config.types) {
+        failures += RunForked(CBenchCase{ shape, type, size }, config);
+      }
+    }
+  }
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#ifndef COMPRESSED_SEGMENTATION_H
+#define COMPRESSED_SEGMENTATION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <zi/vl/vec.hpp>
+
+// One channel in Neuroglancer's compressed_segmentation encoding, all in 32
+// bit words:
+//   channel offset              1 for a single channel
+//   header[blocks][2]           blocks of blockSize voxels, x fastest, then y, z
+//                               [0] table offset (low 24 bits) | index bits << 24
+//                               [1] index offset
+//   indices and label tables    offsets are relative to the channel start
+// Every voxel of a block (including padding past the volume, x fastest)
+// stores a `bits` wide index (0, 1, 2, 4, 8, 16 or 32 bits) into the label
+// table of its block. Labels are labelWords words each (1: uint32, 2: uint64,
+// low word first). Blocks may share tables.
+//
+// A view only, the words are borrowed.
+class CCompressedSegmentation {
+private:
+  const uint32_t                  * data_;
+  size_t                            words_;
+  zi::vl::vec<size_t, 3>            dim_;
+  zi::vl::vec<size_t, 3>            blockSize_;
+  zi::vl::vec<size_t, 3>            grid_;     // blocks per axis
+  size_t                            blockVoxels_;
+  uint8_t                           labelWords_;
+  std::vector<uint32_t>             tableLengths_; // entries per block, empty if the headers don't fit
+
+  void measureTables();
+
+  const uint32_t * channel() const { return data_ + data_[0]; }
+  size_t channelWords() const { return words_ - data_[0]; }
+
+public:
+  CCompressedSegmentation(); // empty
+  CCompressedSegmentation(const uint32_t * data, size_t words, const zi::vl::vec<size_t, 3> & dim,
+                          const zi::vl::vec<size_t, 3> & blockSize, uint8_t labelWords = 1);
+
+  bool empty() const { return data_ == NULL; }
+  // Checks that every header, index array and table lies within the data
+  bool valid() const;
+
+  const uint32_t * data() const { return data_; }
+  size_t words() const { return words_; }
+  const zi::vl::vec<size_t, 3> & dim() const { return dim_; }
+  const zi::vl::vec<size_t, 3> & blockSize() const { return blockSize_; }
+  const zi::vl::vec<size_t, 3> & grid() const { return grid_; }
+  size_t blockVoxels() const { return blockVoxels_; }
+  uint8_t labelWords() const { return labelWords_; }
+
+  // Flags of the table entries of `block` (x + grid[0] * (y + grid[1] * z))
+  // that `selected(uint64_t label)` accepts. Returns their count, the block
+  // can be skipped if it is 0.
+  template<typename Selected>
+  size_t selectTable(size_t block, const Selected & selected, std::vector<uint8_t> & table) const;
+
+  // Writes table[index] for every voxel of the block to `out` (blockVoxels
+  // bytes, x fastest). Indices past the table give 0.
+  void decode(size_t block, const std::vector<uint8_t> & table, uint8_t * out) const;
+};
+
+// Encodes a label volume with a single channel of uint32 labels. Tables are
+// shared between blocks with the same label set. Returns no words if a table
+// offset does not fit into 24 bits.
+template<typename T>
+std::vector<uint32_t> CompressSegmentation(const T * volume, const zi::vl::vec<size_t, 3> & dim, const zi::vl::vec<size_t, 3> & blockSize);
+
+/*****************************************************************/
+
+template<typename Selected>
+size_t CCompressedSegmentation::selectTable(size_t block, const Selected & selected, std::vector<uint8_t> & table) const
+{
+  const size_t offset = channel()[2 * block] & 0xFFFFFF;
+  const size_t length = tableLengths_[block];
+  table.resize(length);
+  const uint32_t * labels = channel() + offset;
+  size_t count = 0;
+  for (size_t i = 0; i < length; ++i) {
+    const uint64_t label = labelWords_ == 2 ? labels[2 * i] | (uint64_t(labels[2 * i + 1]) << 32) : labels[i];
+    table[i] = selected(label) ? 1 : 0;
+    count += table[i];
+  }
+  return count;
+}
+
+#endif
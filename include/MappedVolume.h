@@ -0,0 +1,35 @@
+#pragma once
+
+#ifndef MAPPED_VOLUME_H
+#define MAPPED_VOLUME_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a raw label file, used as input for chunked
+// meshing. Ranges that have been consumed can be handed back to the kernel,
+// so the resident part of the mapping stays bounded by the block size even
+// for files larger than RAM.
+class CMappedVolume {
+private:
+  int                               fd_;
+  char                            * data_;
+  size_t                            size_;
+
+  CMappedVolume(const CMappedVolume &);
+  CMappedVolume & operator=(const CMappedVolume &);
+
+public:
+  explicit CMappedVolume(const std::string & path);
+  ~CMappedVolume();
+
+  bool valid() const { return data_ != NULL; }
+  const char * data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Drops the pages fully inside [begin, end) from memory. They are read
+  // from the file again if accessed later.
+  void release(size_t begin, size_t end);
+};
+
+#endif
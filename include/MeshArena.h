@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+const size_t MESH_ARENA_ALIGNMENT   = 16;
+const size_t MESH_ARENA_FIRST_BLOCK = 64 << 10;
+const size_t MESH_ARENA_MAX_BLOCK   = 4 << 20;
+
+// Monotonic allocator for the output buffers (strips and indexed meshes) of
+// one mesher, freed all together by release() or the destructor. Blocks are
+// mmap'ed, so released meshes go back to the OS. Marching cubes triangles,
+// int_mesh and the simplifier still use the global heap. Thread-safe.
+class CMeshArena {
+private:
+  std::mutex                        mutex_;
+  std::vector<std::pair<char *, size_t>> blocks_; // start and mapped length
+  char                            * cursor_;
+  size_t                            left_;      // in the current block
+  size_t                            nextBlock_;
+  size_t                            reserved_;
+
+  CMeshArena(const CMeshArena &);
+  CMeshArena & operator=(const CMeshArena &);
+
+  char * newBlock(size_t bytes);
+
+public:
+  CMeshArena();
+  ~CMeshArena();
+
+  // MESH_ARENA_ALIGNMENT aligned, never NULL (also for 0 bytes). Throws
+  // std::bad_alloc like new. reservedBytes() counts whole pages.
+  char * allocate(size_t bytes);
+  void release();
+  size_t reservedBytes();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CMappedVolume;
+
+// Mesh blob written by CTaskMesher::Serialize, native byte order:
+//   CMeshBlobHeader
+//   CMeshBlobSection sections[sectionCount]
+//   section data, each starting at a multiple of MESH_BLOB_ALIGNMENT
+// Bump MESH_BLOB_VERSION when the layout or the meshes change.
+const char     MESH_BLOB_MAGIC[4]  = { 'R', 'T', 'M', 'B' };
+const uint32_t MESH_BLOB_VERSION   = 2;
+const size_t   MESH_BLOB_ALIGNMENT = 16;
+
+struct CMeshBlobHeader {
+  char     magic[4];
+  uint32_t version;
+  uint64_t key;          // see MeshCacheKey
+  uint64_t dim[3];
+  uint32_t labelBytes;   // sizeof(T) of the mesher
+  uint8_t  lodCount;     // miplevels + 1
+  uint8_t  formats;      // TaskMesherFormat bit mask
+  uint16_t reserved;
+  uint64_t sectionCount;
+  uint64_t totalBytes;
+};
+
+struct CMeshBlobSection {
+  uint64_t offset;       // from the start of the blob
+  uint64_t length;
+};
+
+// Read-only view of a blob, either a mapped file or a copy in memory. All
+// offsets and lengths are checked once by valid().
+class CMeshBlob {
+private:
+  std::unique_ptr<CMappedVolume>    file_;
+  std::vector<char>                 owned_;
+  const char                      * data_;
+  size_t                            size_;
+
+  CMeshBlob(const CMeshBlob &);
+  CMeshBlob & operator=(const CMeshBlob &);
+
+public:
+  // Maps `path`, nothing is read until the sections are accessed
+  explicit CMeshBlob(const std::string & path);
+  explicit CMeshBlob(std::vector<char> data);
+  ~CMeshBlob();
+
+  bool valid() const;
+  const CMeshBlobHeader & header() const { return *reinterpret_cast<const CMeshBlobHeader *>(data_); }
+  // NULL for empty sections
+  const char * section(size_t index, size_t * length) const;
+};
+
+// Collects the sections of a new blob
+class CMeshBlobWriter {
+private:
+  CMeshBlobHeader                   header_;
+  std::vector<std::pair<const char *, size_t>> sections_;
+
+public:
+  CMeshBlobWriter(uint64_t key, const uint64_t dim[3], uint32_t labelBytes, uint8_t lodCount, uint8_t formats);
+
+  // `data` is referenced until write() returns, it may be NULL if `length` is 0
+  void add(const char * data, size_t length) { sections_.push_back(std::make_pair(data, length)); }
+  void write(std::vector<char> & blob);
+};
+
+// Writes a temporary file next to `path` and renames it, false on failure.
+bool WriteFileAtomic(const std::string & path, const std::vector<char> & data);
+
+// Fast non-cryptographic 64 bit hash, `seed` chains several calls
+uint64_t HashBytes(const void * data, size_t length, uint64_t seed = 0);
+
+#endif
@@ -3,6 +3,8 @@
 #ifndef MESH_IO_H
 #define MESH_IO_H
 
+#include "MeshArena.h"
+
 #include <zi/mesh/quadratic_simplifier.hpp>
 #include <string>
 #include <vector>
@@ -12,11 +14,100 @@ typedef zi::vl::vec<uint32_t, 3> vec3u;
 typedef zi::vl::vec<uint32_t, 4> vec4u;
 typedef zi::vl::vec<uint32_t, 5> vec5u;
 
-std::vector<float> CreateDegTriStrip(zi::mesh::simplifier<double> &s);
+// Float structure-of-arrays copy of the simplifier output in output axis
+// order (x, y, z), what the serializers read. The simplifier stays double.
+struct CVertexArrays {
+  std::vector<float> position[3];
+  std::vector<float> normal[3];
+};
+
+void ToVertexArrays(CVertexArrays & out,
+                    const std::vector<zi::vl::vec3d> & points,
+                    const std::vector<zi::vl::vec3d> & normals);
+
+// Affine map of the output vertices, p' = linear * p + offset, on twice the
+// voxel coordinates. Normals use the inverse transpose.
+struct CVertexTransform {
+  float linear[3][3];
+  float offset[3];
+
+  CVertexTransform(); // identity
+  // Row-major 3x4 [linear | offset]
+  explicit CVertexTransform(const float affine[12]);
+  static CVertexTransform Scale(const float scale[3]);
+  bool isIdentity() const;
+};
+
+void TransformVertexArrays(CVertexArrays & vertices, const CVertexTransform & transform);
+
+// In place on finished buffers: `vertexCount` interleaved strip vertices, or
+// a whole indexed mesh (scales only change its header, other maps requantize).
+void TransformDegTriStrip(float * data, size_t vertexCount, const CVertexTransform & transform);
+void TransformIndexedMesh(char * data, const CVertexTransform & transform);
+
+// `vertexCount` (optional) receives the number of distinct vertices,
+// `transform` (optional) is applied before the vertices are written
+std::vector<float> CreateDegTriStrip(zi::mesh::simplifier<double> &s, size_t * vertexCount = NULL,
+                                     const CVertexTransform * transform = NULL);
+// Written straight into `arena`, `length` receives the size in bytes
+char * CreateDegTriStrip(zi::mesh::simplifier<double> &s, CMeshArena & arena, size_t * length,
+                         size_t * vertexCount = NULL, const CVertexTransform * transform = NULL);
+
+// Post-transform vertex cache assumed by the index ordering and the ACMR
+// (average cache miss ratio, vertex shader runs per triangle) in the stats
+const size_t MESH_VERTEX_CACHE_SIZE = 16;
+
+// Reorders the triangles (3 indices each, winding kept) for a FIFO vertex
+// cache of `cacheSize` entries: Tipsify (Sander et al. 2007), linear time.
+void OptimizeVertexCache(std::vector<uint32_t> & indices, size_t vertexCount, size_t cacheSize = MESH_VERTEX_CACHE_SIZE);
+// Renumbers the vertices in order of first use (UINT32_MAX if unused),
+// returns the number of used vertices.
+size_t OptimizeVertexFetch(std::vector<uint32_t> & indices, size_t vertexCount, std::vector<uint32_t> & remap);
+// Simulated FIFO cache misses per triangle, between 0.5 and 3
+double AverageCacheMissRatio(const std::vector<uint32_t> & indices, size_t vertexCount, size_t cacheSize = MESH_VERTEX_CACHE_SIZE);
+
+// Compact indexed mesh, little-endian:
+//   CIndexedMeshHeader
+//   uint16_t positions[vertexCount][3]  quantized, p = origin + q * scale
+//   int8_t   normals[vertexCount][2]    octahedral, snorm8
+//   uint16_t or uint32_t indices[indexCount] (see indexSize)
+// Axis order and winding as in the strips, equal quantized vertices welded.
+const uint32_t INDEXED_MESH_VERSION = 1;
+
+struct CIndexedMeshHeader {
+  char     magic[4];       // "RTMI"
+  uint32_t version;
+  uint32_t vertexCount;
+  uint32_t indexCount;     // 3 per triangle
+  uint32_t indexSize;      // 2 or 4 bytes
+  float    origin[3];
+  float    scale[3];
+};
+
+// `acmr` (optional) receives the AverageCacheMissRatio of the indices
+std::vector<char> CreateIndexedMesh(zi::mesh::simplifier<double> &s, size_t * vertexCount = NULL,
+                                    const CVertexTransform * transform = NULL, double * acmr = NULL);
+char * CreateIndexedMesh(zi::mesh::simplifier<double> &s, CMeshArena & arena, size_t * length, size_t * vertexCount = NULL,
+                         const CVertexTransform * transform = NULL, double * acmr = NULL);
 bool WriteDegTriStrip(zi::mesh::simplifier<double> & s, const std::string & filename);
 bool WriteTriMesh(zi::mesh::simplifier<double> & s, const std::string & filename);
 bool WriteObj(zi::mesh::simplifier<double> & s, const std::string & filename);
 
+// Strip vertices (6 floats each) tri_strip_to_degenerate writes
+size_t DegenerateStripLength(const std::vector<uint32_t> & lengths);
+
+void tri_strip_to_degenerate(float * out,
+                             const CVertexArrays & vertices,
+                             const std::vector<uint32_t> & indices,
+                             const std::vector<uint32_t> & starts,
+                             const std::vector<uint32_t> & lengths);
+
+void tri_strip_to_degenerate(std::vector<float> & newpoints,
+                             const CVertexArrays & vertices,
+                             const std::vector<uint32_t> & indices,
+                             const std::vector<uint32_t> & starts,
+                             const std::vector<uint32_t> & lengths);
+
 void tri_strip_to_degenerate(std::vector<float> & newpoints,
                              const std::vector<zi::vl::vec3d> & points,
                              const std::vector<zi::vl::vec3d> & normals,
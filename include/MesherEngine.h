@@ -0,0 +1,146 @@
+#pragma once
+
+#ifndef MESHER_ENGINE_H
+#define MESHER_ENGINE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "TaskMesher.h"
+
+// Long-lived pool of mesher workers. Jobs are queued by priority (higher
+// first, FIFO within a priority) and run on a fixed number of threads, each
+// of which keeps a CMesherScratch across jobs. A job submitted with a nonzero
+// key supersedes the unfinished jobs of the same key: queued ones are dropped
+// right away, running ones are cancelled through their job's CCancelToken.
+class CMesherEngine {
+public:
+  // Runs on a worker, returns the result handed out by Take (NULL on failure).
+  // `cancel` is triggered by Cancel and superseding jobs.
+  typedef std::function<void * (CMesherScratch & scratch, const std::shared_ptr<const CCancelToken> & cancel)> Work;
+  // Frees a result that is never taken
+  typedef std::function<void (void * result)> Release;
+  // Called on the worker (or the cancelling thread) once a job is final
+  typedef std::function<void (uint64_t job, TaskMesherJobStatus status)> Callback;
+
+private:
+  struct CJob {
+    Work                            work;
+    Release                         release;
+    int                             priority;
+    uint64_t                        key;
+    TaskMesherJobStatus             status;
+    bool                            cancelled; // while running: discard the result
+    std::shared_ptr<CCancelToken>   cancel;
+    void                          * result;
+  };
+
+  const Callback                    done_;
+  std::map<uint64_t, CJob>          jobs_;
+  std::set<std::pair<int64_t, uint64_t>> queue_; // (-priority, job), so begin() is the next job
+  uint64_t                          nextJob_;
+  bool                              stopping_;
+  mutable std::mutex                mutex_;
+  std::condition_variable           wake_;
+  std::vector<std::thread>          workers_;
+
+  CMesherEngine(const CMesherEngine &);
+  CMesherEngine & operator=(const CMesherEngine &);
+
+  void run();
+  void cancelLocked(uint64_t job, std::vector<uint64_t> & dropped);
+  void notify(const std::vector<uint64_t> & dropped);
+
+public:
+  explicit CMesherEngine(size_t threadCount, const Callback & done = Callback());
+  // Drops queued jobs, waits for running ones and frees all untaken results
+  ~CMesherEngine();
+
+  // The job's cancel token is a child of `parent` (may be null)
+  uint64_t Submit(const Work & work, const Release & release, int priority = 0, uint64_t key = 0,
+                  const std::shared_ptr<const CCancelToken> & parent = nullptr);
+  TaskMesherJobStatus Poll(uint64_t job) const;
+  // Queued jobs are dropped, running ones stop at their next check and are
+  // discarded. Returns false if the job is unknown or already final.
+  bool Cancel(uint64_t job);
+  // Forgets a final job and hands out its result (NULL unless DONE), which
+  // then belongs to the caller. Returns NULL and keeps unfinished jobs.
+  void * Take(uint64_t job);
+
+  // Borrows `segmentation` like the in-place CTaskMesher, it has to stay
+  // valid until the job is final. Segments and options are copied, the
+  // job's token replaces options.cancelToken and is cancelled with it.
+  template<typename T>
+  uint64_t SubmitMesh(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options, int priority = 0, uint64_t key = 0);
+  // Compressed labels, borrowed the same way. Invalid encodings fail the job.
+  template<typename T>
+  uint64_t SubmitMesh(const CCompressedSegmentation & segmentation, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options, int priority = 0, uint64_t key = 0);
+  // Labels with a segment index, both borrowed. Invalid indices fail the job.
+  template<typename T>
+  uint64_t SubmitMesh(const T * segmentation, const CSegmentIndex<T> & index, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options, int priority = 0, uint64_t key = 0);
+};
+
+/*****************************************************************/
+
+template<typename T>
+uint64_t CMesherEngine::SubmitMesh(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+                                   const CTaskMesherOptions & options, int priority, uint64_t key)
+{
+  Work work = [segmentation, dim, segments, mipCount, options](CMesherScratch & scratch, const std::shared_ptr<const CCancelToken> & cancel) -> void * {
+    CTaskMesherOptions jobOptions(options);
+    jobOptions.cancelToken = cancel;
+    return new CTaskMesher<T>(segmentation, dim, segments, mipCount, jobOptions, &scratch);
+  };
+  Release release = [](void * result) { delete static_cast<CTaskMesher<T> *>(result); };
+  return Submit(work, release, priority, key, options.cancelToken);
+}
+
+template<typename T>
+uint64_t CMesherEngine::SubmitMesh(const CCompressedSegmentation & segmentation, const std::vector<T> & segments, uint8_t mipCount,
+                                   const CTaskMesherOptions & options, int priority, uint64_t key)
+{
+  Work work = [segmentation, segments, mipCount, options](CMesherScratch & scratch, const std::shared_ptr<const CCancelToken> & cancel) -> void * {
+    CTaskMesherOptions jobOptions(options);
+    jobOptions.cancelToken = cancel;
+    CTaskMesher<T> * mesher = new CTaskMesher<T>(segmentation, segments, mipCount, jobOptions, &scratch);
+    if (mesher->ReadFailed()) {
+      delete mesher;
+      return NULL;
+    }
+    return mesher;
+  };
+  Release release = [](void * result) { delete static_cast<CTaskMesher<T> *>(result); };
+  return Submit(work, release, priority, key, options.cancelToken);
+}
+
+template<typename T>
+uint64_t CMesherEngine::SubmitMesh(const T * segmentation, const CSegmentIndex<T> & index, const std::vector<T> & segments, uint8_t mipCount,
+                                   const CTaskMesherOptions & options, int priority, uint64_t key)
+{
+  const CSegmentIndex<T> * indexPtr = &index;
+  Work work = [segmentation, indexPtr, segments, mipCount, options](CMesherScratch & scratch, const std::shared_ptr<const CCancelToken> & cancel) -> void * {
+    CTaskMesherOptions jobOptions(options);
+    jobOptions.cancelToken = cancel;
+    CTaskMesher<T> * mesher = new CTaskMesher<T>(segmentation, *indexPtr, segments, mipCount, jobOptions, &scratch);
+    if (mesher->ReadFailed()) {
+      delete mesher;
+      return NULL;
+    }
+    return mesher;
+  };
+  Release release = [](void * result) { delete static_cast<CTaskMesher<T> *>(result); };
+  return Submit(work, release, priority, key, options.cancelToken);
+}
+
+#endif
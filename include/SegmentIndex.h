@@ -0,0 +1,373 @@
+#pragma once
+
+#ifndef SEGMENT_INDEX_H
+#define SEGMENT_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <zi/vl/vec.hpp>
+
+#include "SegmentMask.h"
+
+// Serialized index, native byte order like mesh blobs:
+//   CSegmentIndexHeader
+//   CSegmentIndexRecord records[labelCount]   sorted by label
+//   uint32_t blocks[blockCount]               record i owns [records[i - 1].blockEnd, records[i].blockEnd)
+const char     SEGMENT_INDEX_MAGIC[4] = { 'R', 'T', 'S', 'X' }; // not RTMI, that is the indexed mesh
+const uint32_t SEGMENT_INDEX_VERSION  = 1;
+const size_t   SEGMENT_INDEX_BLOCK    = 16; // Default block edge in voxels
+
+struct CSegmentIndexHeader {
+  char     magic[4];
+  uint32_t version;
+  uint64_t dim[3];
+  uint32_t blockSize;
+  uint32_t labelBytes;   // sizeof(T) of the index
+  uint64_t labelCount;
+  uint64_t blockCount;
+};
+
+struct CSegmentIndexRecord {
+  uint64_t label;
+  uint64_t voxels;
+  uint64_t blockEnd;
+  uint32_t min[3];
+  uint32_t max[3];
+};
+
+/*****************************************************************/
+
+// Bounds and occupied blockSize^3 blocks of every label of a task, built in
+// one pass. Immutable, meshers may share one index.
+template<typename T>
+class CSegmentIndex {
+private:
+  struct CLabelEntry {
+    CSelectionBounds                bounds;
+    std::vector<uint32_t>           blocks; // ascending
+    explicit CLabelEntry(const zi::vl::vec<size_t, 3> & dim) : bounds(dim) {}
+  };
+  typedef std::unordered_map<T, CLabelEntry> CLabelMap;
+
+  zi::vl::vec<size_t, 3>            dim_;
+  size_t                            blockSize_;
+  zi::vl::vec<size_t, 3>            grid_;     // blocks per axis
+  bool                              valid_;
+
+  std::vector<T>                    labels_;   // ascending
+  std::vector<CSelectionBounds>     bounds_;
+  std::vector<size_t>               blockEnd_;
+  std::vector<uint32_t>             blocks_;
+
+  void setGrid();
+  void scan(const T * volume, size_t bzBegin, size_t bzEnd, CLabelMap & labels) const;
+  size_t find(T label) const;
+
+public:
+  // Reads `volume` once, z-slabs of whole block layers on up to threadCount
+  // threads. The volume is not referenced afterwards.
+  CSegmentIndex(const T * volume, const zi::vl::vec<size_t, 3> & dim, size_t blockSize = SEGMENT_INDEX_BLOCK, size_t threadCount = 1);
+  // Loads a serialized index, see valid()
+  CSegmentIndex(const char * data, size_t length);
+
+  // False if the serialized index was malformed or of another label type
+  bool valid() const { return valid_; }
+  const zi::vl::vec<size_t, 3> & dim() const { return dim_; }
+  size_t blockSize() const { return blockSize_; }
+  const zi::vl::vec<size_t, 3> & grid() const { return grid_; }
+  size_t labelCount() const { return labels_.size(); }
+
+  // Union of the bounds of `labels` (any container of T), labels missing
+  // from the volume are ignored
+  template<typename Labels>
+  CSelectionBounds bounds(const Labels & labels) const;
+
+  // Sets blocks[b] (grid[0] * grid[1] * grid[2] flags) to 1 for the blocks
+  // holding a voxel of `labels`, all others to 0. Returns their count.
+  template<typename Labels>
+  size_t occupancy(const Labels & labels, std::vector<uint8_t> & blocks) const;
+
+  void serialize(std::vector<char> & data) const;
+};
+
+/*****************************************************************/
+
+template<typename T>
+void CSegmentIndex<T>::setGrid()
+{
+  for (int i = 0; i < 3; ++i) {
+    grid_[i] = (dim_[i] + blockSize_ - 1) / blockSize_;
+  }
+}
+
+template<typename T>
+CSegmentIndex<T>::CSegmentIndex(const T * volume, const zi::vl::vec<size_t, 3> & dim, size_t blockSize, size_t threadCount) :
+dim_(dim), blockSize_(std::max<size_t>(1, blockSize)), grid_(0, 0, 0), valid_(true)
+{
+  setGrid();
+  if (dim_[0] < 3 || dim_[1] < 3 || dim_[2] < 3) { // Nothing off the task border
+    return;
+  }
+
+  const size_t slabs = std::max<size_t>(1, std::min(threadCount, grid_[2]));
+  std::vector<CLabelMap> partial(slabs);
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < slabs; ++i) {
+    workers.emplace_back([&, i]() {
+      scan(volume, grid_[2] * i / slabs, grid_[2] * (i + 1) / slabs, partial[i]);
+    });
+  }
+  scan(volume, 0, grid_[2] / slabs, partial[0]);
+  for (auto & worker : workers) {
+    worker.join();
+  }
+
+  // Slabs are in z order, so appending their block lists keeps them sorted
+  CLabelMap & merged = partial[0];
+  for (size_t i = 1; i < slabs; ++i) {
+    for (auto it = partial[i].begin(); it != partial[i].end(); ++it) {
+      auto found = merged.find(it->first);
+      if (found == merged.end()) {
+        merged.emplace(it->first, std::move(it->second));
+        continue;
+      }
+      CSelectionBounds & b = found->second.bounds;
+      for (int d = 0; d < 3; ++d) {
+        b.min[d] = std::min(b.min[d], it->second.bounds.min[d]);
+        b.max[d] = std::max(b.max[d], it->second.bounds.max[d]);
+      }
+      b.voxels += it->second.bounds.voxels;
+      found->second.blocks.insert(found->second.blocks.end(), it->second.blocks.begin(), it->second.blocks.end());
+    }
+    CLabelMap().swap(partial[i]);
+  }
+
+  labels_.reserve(merged.size());
+  for (auto it = merged.begin(); it != merged.end(); ++it) {
+    labels_.push_back(it->first);
+  }
+  std::sort(labels_.begin(), labels_.end());
+
+  bounds_.reserve(labels_.size());
+  blockEnd_.reserve(labels_.size());
+  for (auto label = labels_.begin(); label != labels_.end(); ++label) {
+    const CLabelEntry & entry = merged.find(*label)->second;
+    bounds_.push_back(entry.bounds);
+    blocks_.insert(blocks_.end(), entry.blocks.begin(), entry.blocks.end());
+    blockEnd_.push_back(blocks_.size());
+  }
+}
+
+/*****************************************************************/
+
+// Indexes the interior voxels of the block layers [bzBegin, bzEnd), each
+// label gets its blocks once and in order.
+template<typename T>
+void CSegmentIndex<T>::scan(const T * volume, size_t bzBegin, size_t bzEnd, CLabelMap & labels) const
+{
+  CLabelEntry * entry = NULL;
+  T previous = T();
+
+  for (size_t bz = bzBegin; bz < bzEnd; ++bz) {
+    const size_t zBegin = std::max<size_t>(bz * blockSize_, 1), zEnd = std::min((bz + 1) * blockSize_, dim_[2] - 1);
+    for (size_t by = 0; by < grid_[1]; ++by) {
+      const size_t yBegin = std::max<size_t>(by * blockSize_, 1), yEnd = std::min((by + 1) * blockSize_, dim_[1] - 1);
+      for (size_t bx = 0; bx < grid_[0]; ++bx) {
+        const size_t xBegin = std::max<size_t>(bx * blockSize_, 1), xEnd = std::min((bx + 1) * blockSize_, dim_[0] - 1);
+        const uint32_t block = static_cast<uint32_t>(bx + grid_[0] * (by + grid_[1] * bz));
+
+        for (size_t z = zBegin; z < zEnd; ++z) {
+          for (size_t y = yBegin; y < yEnd; ++y) {
+            const T * row = volume + dim_[0] * (y + dim_[1] * z);
+            for (size_t x = xBegin; x < xEnd; ) {
+              const T label = row[x];
+              const size_t first = x;
+              while (x < xEnd && row[x] == label) ++x;
+
+              if (!entry || label != previous) {
+                entry = &labels.emplace(label, CLabelEntry(dim_)).first->second;
+                previous = label;
+              }
+              CSelectionBounds & b = entry->bounds;
+              b.min[0] = std::min(b.min[0], first);
+              b.max[0] = std::max(b.max[0], x - 1);
+              b.min[1] = std::min(b.min[1], y);
+              b.max[1] = std::max(b.max[1], y);
+              b.min[2] = std::min(b.min[2], z);
+              b.max[2] = std::max(b.max[2], z);
+              b.voxels += x - first;
+              if (entry->blocks.empty() || entry->blocks.back() != block) {
+                entry->blocks.push_back(block);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+size_t CSegmentIndex<T>::find(T label) const
+{
+  const auto it = std::lower_bound(labels_.begin(), labels_.end(), label);
+  return it != labels_.end() && *it == label ? it - labels_.begin() : SIZE_MAX;
+}
+
+template<typename T>
+template<typename Labels>
+CSelectionBounds CSegmentIndex<T>::bounds(const Labels & labels) const
+{
+  CSelectionBounds result(dim_);
+  for (auto it = labels.begin(); it != labels.end(); ++it) {
+    const size_t i = find(*it);
+    if (i == SIZE_MAX) continue;
+    for (int d = 0; d < 3; ++d) {
+      result.min[d] = std::min(result.min[d], bounds_[i].min[d]);
+      result.max[d] = std::max(result.max[d], bounds_[i].max[d]);
+    }
+    result.voxels += bounds_[i].voxels;
+  }
+  return result;
+}
+
+template<typename T>
+template<typename Labels>
+size_t CSegmentIndex<T>::occupancy(const Labels & labels, std::vector<uint8_t> & blocks) const
+{
+  blocks.assign(grid_[0] * grid_[1] * grid_[2], 0);
+  size_t count = 0;
+  for (auto it = labels.begin(); it != labels.end(); ++it) {
+    const size_t i = find(*it);
+    if (i == SIZE_MAX) continue;
+    for (size_t b = i > 0 ? blockEnd_[i - 1] : 0; b < blockEnd_[i]; ++b) {
+      count += blocks[blocks_[b]] == 0;
+      blocks[blocks_[b]] = 1;
+    }
+  }
+  return count;
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CSegmentIndex<T>::serialize(std::vector<char> & data) const
+{
+  CSegmentIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SEGMENT_INDEX_MAGIC, sizeof(header.magic));
+  header.version = SEGMENT_INDEX_VERSION;
+  for (int i = 0; i < 3; ++i) {
+    header.dim[i] = dim_[i];
+  }
+  header.blockSize = static_cast<uint32_t>(blockSize_);
+  header.labelBytes = sizeof(T);
+  header.labelCount = labels_.size();
+  header.blockCount = blocks_.size();
+
+  data.resize(sizeof(header) + labels_.size() * sizeof(CSegmentIndexRecord) + blocks_.size() * sizeof(uint32_t));
+  memcpy(data.data(), &header, sizeof(header));
+
+  char * out = data.data() + sizeof(header);
+  for (size_t i = 0; i < labels_.size(); ++i, out += sizeof(CSegmentIndexRecord)) {
+    CSegmentIndexRecord record;
+    memset(&record, 0, sizeof(record));
+    record.label = labels_[i];
+    record.voxels = bounds_[i].voxels;
+    record.blockEnd = blockEnd_[i];
+    for (int d = 0; d < 3; ++d) {
+      record.min[d] = static_cast<uint32_t>(bounds_[i].min[d]);
+      record.max[d] = static_cast<uint32_t>(bounds_[i].max[d]);
+    }
+    memcpy(out, &record, sizeof(record));
+  }
+  if (!blocks_.empty()) {
+    memcpy(out, blocks_.data(), blocks_.size() * sizeof(uint32_t));
+  }
+}
+
+/*****************************************************************/
+
+// Every count, offset and coordinate is checked, a malformed index is left
+// empty and invalid
+template<typename T>
+CSegmentIndex<T>::CSegmentIndex(const char * data, size_t length) :
+dim_(0, 0, 0), blockSize_(1), grid_(0, 0, 0), valid_(false)
+{
+  CSegmentIndexHeader header;
+  if (!data || length < sizeof(header)) {
+    return;
+  }
+  memcpy(&header, data, sizeof(header));
+
+  const size_t payload = length - sizeof(header);
+  if (memcmp(header.magic, SEGMENT_INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != SEGMENT_INDEX_VERSION ||
+      header.labelBytes != sizeof(T) || header.blockSize == 0 ||
+      header.labelCount > payload / sizeof(CSegmentIndexRecord) || header.blockCount > payload / sizeof(uint32_t) ||
+      payload != header.labelCount * sizeof(CSegmentIndexRecord) + header.blockCount * sizeof(uint32_t)) {
+    return;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (header.dim[i] > std::numeric_limits<uint32_t>::max()) {
+      return;
+    }
+    dim_[i] = header.dim[i];
+  }
+  blockSize_ = header.blockSize;
+  setGrid();
+  const uint64_t gridBlocks = uint64_t(grid_[0]) * grid_[1] * grid_[2];
+
+  std::vector<T> labels(header.labelCount);
+  std::vector<CSelectionBounds> bounds(header.labelCount, CSelectionBounds(dim_));
+  std::vector<size_t> blockEnd(header.labelCount);
+  std::vector<uint32_t> blocks(header.blockCount);
+
+  const char * in = data + sizeof(header);
+  for (size_t i = 0; i < labels.size(); ++i, in += sizeof(CSegmentIndexRecord)) {
+    CSegmentIndexRecord record;
+    memcpy(&record, in, sizeof(record));
+    if (record.label > std::numeric_limits<T>::max() || (i > 0 && record.label <= labels[i - 1]) ||
+        record.blockEnd < (i > 0 ? blockEnd[i - 1] : 0) || record.blockEnd > header.blockCount) {
+      return;
+    }
+    for (int d = 0; d < 3; ++d) {
+      if (record.min[d] > record.max[d] || record.max[d] >= dim_[d]) {
+        return;
+      }
+      bounds[i].min[d] = record.min[d];
+      bounds[i].max[d] = record.max[d];
+    }
+    labels[i] = static_cast<T>(record.label);
+    bounds[i].voxels = record.voxels;
+    blockEnd[i] = record.blockEnd;
+  }
+  if ((blockEnd.empty() ? 0 : blockEnd.back()) != blocks.size()) {
+    return;
+  }
+  if (!blocks.empty()) {
+    memcpy(blocks.data(), in, blocks.size() * sizeof(uint32_t));
+  }
+
+  for (size_t i = 0, b = 0; i < labels.size(); ++i) {
+    for (const size_t begin = b; b < blockEnd[i]; ++b) {
+      if (blocks[b] >= gridBlocks || (b > begin && blocks[b] <= blocks[b - 1])) {
+        return;
+      }
+    }
+  }
+
+  labels_.swap(labels);
+  bounds_.swap(bounds);
+  blockEnd_.swap(blockEnd);
+  blocks_.swap(blocks);
+  valid_ = true;
+}
+
+#endif
@@ -0,0 +1,393 @@
+#pragma once
+
+#ifndef SEGMENT_MASK_H
+#define SEGMENT_MASK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+#include <zi/vl/vec.hpp>
+
+// Row kernels for uint32 labels against at most SEGMENT_MASK_SIMD_MAX
+// segments. ScanRowSmallSet only counts the selected voxels and reports the
+// first and last selected position (untouched if none), MaskRowSmallSet
+// writes 1 for selected and 0 for all other voxels. Both dispatch to AVX2 or
+// SSE2 at runtime, see SegmentMask.cpp.
+const size_t SEGMENT_MASK_SIMD_MAX = 8;
+size_t ScanRowSmallSet(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount, size_t & first, size_t & last);
+void   MaskRowSmallSet(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount, uint8_t * mask);
+
+/*****************************************************************/
+
+// murmur3 fmix32. Tables index with the low bits, which a plain multiply
+// leaves depending only on the low label bits (strided IDs would cluster).
+inline size_t HashLabel(uint32_t label) {
+  label ^= label >> 16;
+  label *= 0x85ebca6bu;
+  label ^= label >> 13;
+  label *= 0xc2b2ae35u;
+  label ^= label >> 16;
+  return label;
+}
+
+/*****************************************************************/
+
+// Constant time segment membership test. uint8/uint16 labels use a bitmap
+// over the full label range, uint32 labels a flat open-addressing hash table
+// (or the SIMD small-set kernels when only a few segments are selected).
+template<typename T>
+class CSegmentMask {
+private:
+  std::vector<uint64_t>             bitmap_;
+  std::vector<T>                    table_;
+  size_t                            tableMask_;
+  bool                              hasZero_;
+  std::vector<T>                    small_;
+
+  static size_t hash(T label) {
+    return HashLabel(static_cast<uint32_t>(label));
+  }
+
+  size_t scanRow(const T * row, size_t length, size_t & first, size_t & last) const;
+  void maskRow(const T * row, size_t length, uint8_t * mask) const;
+
+public:
+  explicit CSegmentMask(const std::set<T> & segments);
+
+  inline bool contains(T label) const {
+    if (sizeof(T) <= 2) {
+      return (bitmap_[label >> 6] >> (label & 63)) & 1;
+    }
+    if (label == 0) {
+      return hasZero_;
+    }
+    for (size_t i = hash(label) & tableMask_; ; i = (i + 1) & tableMask_) {
+      if (table_[i] == label) return true;
+      if (table_[i] == 0) return false;
+    }
+  }
+
+  // Single read-only pass over the labels. Grows [bboxMin, bboxMax] to include
+  // all selected voxels off the task border and returns their count.
+  // `volume` may hold only the planes [zFirst, zFirst + zCount) of a task of
+  // size `dim`, then only those are scanned.
+  size_t bounds(const T * volume, const zi::vl::vec<size_t, 3> & dim,
+                zi::vl::vec<size_t, 3> & bboxMin, zi::vl::vec<size_t, 3> & bboxMax,
+                size_t zFirst = 0, size_t zCount = SIZE_MAX) const;
+
+  // Writes the 0/1 mask of the block at `origin` with size `extent` into
+  // `mask` (extent[0] * extent[1] * extent[2] bytes). Voxels on the task
+  // border are always 0, so the mesh is closed at the task boundary.
+  // `volume` starts at plane `zFirst`, which must not lie after origin[2].
+  void extract(const T * volume, const zi::vl::vec<size_t, 3> & dim,
+               const zi::vl::vec<size_t, 3> & origin, const zi::vl::vec<size_t, 3> & extent, uint8_t * mask,
+               size_t zFirst = 0) const;
+};
+
+/*****************************************************************/
+
+template<typename T>
+CSegmentMask<T>::CSegmentMask(const std::set<T> & segments) :
+tableMask_(0), hasZero_(segments.count(0) > 0)
+{
+  if (sizeof(T) <= 2) {
+    bitmap_.assign(((size_t(1) << (8 * sizeof(T))) + 63) / 64, 0);
+    for (auto it = segments.begin(); it != segments.end(); ++it) {
+      bitmap_[*it >> 6] |= uint64_t(1) << (*it & 63);
+    }
+    return;
+  }
+
+  if (segments.size() <= SEGMENT_MASK_SIMD_MAX) {
+    small_.assign(segments.begin(), segments.end());
+  }
+
+  // Load factor <= 0.5, 0 marks an empty slot (label 0 is tracked by hasZero_)
+  size_t capacity = 16;
+  while (capacity < 2 * segments.size()) {
+    capacity <<= 1;
+  }
+  table_.assign(capacity, 0);
+  tableMask_ = capacity - 1;
+
+  for (auto it = segments.begin(); it != segments.end(); ++it) {
+    if (*it == 0) continue;
+    size_t i = hash(*it) & tableMask_;
+    while (table_[i] != 0) {
+      i = (i + 1) & tableMask_;
+    }
+    table_[i] = *it;
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+size_t CSegmentMask<T>::scanRow(const T * row, size_t length, size_t & first, size_t & last) const {
+  size_t count = 0;
+  for (size_t x = 0; x < length; ++x) {
+    if (contains(row[x])) {
+      if (count == 0) first = x;
+      last = x;
+      ++count;
+    }
+  }
+  return count;
+}
+
+template<>
+inline size_t CSegmentMask<uint32_t>::scanRow(const uint32_t * row, size_t length, size_t & first, size_t & last) const {
+  if (!small_.empty()) {
+    return ScanRowSmallSet(row, length, &small_[0], small_.size(), first, last);
+  }
+
+  size_t count = 0;
+  for (size_t x = 0; x < length; ++x) {
+    if (contains(row[x])) {
+      if (count == 0) first = x;
+      last = x;
+      ++count;
+    }
+  }
+  return count;
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CSegmentMask<T>::maskRow(const T * row, size_t length, uint8_t * mask) const {
+  for (size_t x = 0; x < length; ++x) {
+    mask[x] = contains(row[x]);
+  }
+}
+
+template<>
+inline void CSegmentMask<uint32_t>::maskRow(const uint32_t * row, size_t length, uint8_t * mask) const {
+  if (!small_.empty()) {
+    MaskRowSmallSet(row, length, &small_[0], small_.size(), mask);
+    return;
+  }
+
+  for (size_t x = 0; x < length; ++x) {
+    mask[x] = contains(row[x]);
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+size_t CSegmentMask<T>::bounds(const T * volume, const zi::vl::vec<size_t, 3> & dim,
+                               zi::vl::vec<size_t, 3> & bboxMin, zi::vl::vec<size_t, 3> & bboxMax,
+                               size_t zFirst, size_t zCount) const {
+  if (dim[0] < 3 || dim[1] < 3 || dim[2] < 3) {
+    return 0;
+  }
+
+  const size_t zBegin = std::max<size_t>(zFirst, 1);
+  const size_t zEnd = zCount < dim[2] - zFirst ? zFirst + zCount : dim[2];
+
+  size_t selected = 0;
+  for (size_t z = zBegin; z < std::min(zEnd, dim[2] - 1); ++z) {
+    for (size_t y = 1; y < dim[1] - 1; ++y) {
+      const T * row = volume + dim[0] * (y + dim[1] * (z - zFirst));
+
+      size_t first, last;
+      const size_t count = scanRow(row + 1, dim[0] - 2, first, last);
+      if (count > 0) {
+        bboxMin[0] = std::min(bboxMin[0], first + 1);
+        bboxMax[0] = std::max(bboxMax[0], last + 1);
+        bboxMin[1] = std::min(bboxMin[1], y);
+        bboxMax[1] = std::max(bboxMax[1], y);
+        bboxMin[2] = std::min(bboxMin[2], z);
+        bboxMax[2] = std::max(bboxMax[2], z);
+        selected += count;
+      }
+    }
+  }
+
+  return selected;
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CSegmentMask<T>::extract(const T * volume, const zi::vl::vec<size_t, 3> & dim,
+                              const zi::vl::vec<size_t, 3> & origin, const zi::vl::vec<size_t, 3> & extent, uint8_t * mask,
+                              size_t zFirst) const {
+  // Interior x range of the task, relative to the block
+  const size_t xBegin = origin[0] == 0 ? 1 : 0;
+  const size_t xEnd = std::min(origin[0] + extent[0], dim[0] - 1) - origin[0];
+
+  for (size_t z = origin[2]; z < origin[2] + extent[2]; ++z) {
+    for (size_t y = origin[1]; y < origin[1] + extent[1]; ++y, mask += extent[0]) {
+      if (z == 0 || z == dim[2] - 1 || y == 0 || y == dim[1] - 1 || xBegin >= xEnd) {
+        memset(mask, 0, extent[0]);
+        continue;
+      }
+
+      const T * row = volume + origin[0] + dim[0] * (y + dim[1] * (z - zFirst));
+      memset(mask, 0, xBegin);
+      maskRow(row + xBegin, xEnd - xBegin, mask + xBegin);
+      memset(mask + xEnd, 0, extent[0] - xEnd);
+    }
+  }
+}
+
+/*****************************************************************/
+
+// Inclusive bounding box and count of the selected voxels off the task border
+struct CSelectionBounds {
+  zi::vl::vec<size_t, 3>            min;
+  zi::vl::vec<size_t, 3>            max;
+  size_t                            voxels;
+
+  explicit CSelectionBounds(const zi::vl::vec<size_t, 3> & dim) : min(dim), max(0, 0, 0), voxels(0) {}
+};
+
+/*****************************************************************/
+
+// Maps labels to the index of the (disjoint) segment group containing them,
+// for meshing several groups from one pass over the labels. Same layout as
+// CSegmentMask: a dense table for uint8/uint16 labels, a flat open-addressing
+// hash table for uint32 labels.
+template<typename T>
+class CSegmentGroupTable {
+private:
+  std::vector<uint32_t>             dense_;
+  std::vector<T>                    keys_;
+  std::vector<uint32_t>             groups_;
+  size_t                            tableMask_;
+  uint32_t                          zeroGroup_;
+
+  static size_t hash(T label) {
+    return HashLabel(static_cast<uint32_t>(label));
+  }
+
+public:
+  static const uint32_t NONE = 0xffffffff;
+
+  // A label listed in several groups belongs to the last of them
+  explicit CSegmentGroupTable(const std::vector<std::vector<T>> & groups);
+
+  inline uint32_t group(T label) const {
+    if (sizeof(T) <= 2) {
+      return dense_[label];
+    }
+    if (label == 0) {
+      return zeroGroup_;
+    }
+    for (size_t i = hash(label) & tableMask_; ; i = (i + 1) & tableMask_) {
+      if (keys_[i] == label) return groups_[i];
+      if (keys_[i] == 0) return NONE;
+    }
+  }
+
+  // Single read-only pass over the planes [zBegin, zEnd) of the labels, grows
+  // bounds[g] (one per group) by the selected voxels of group g off the task
+  // border.
+  void bounds(const T * volume, const zi::vl::vec<size_t, 3> & dim, size_t zBegin, size_t zEnd,
+              std::vector<CSelectionBounds> & bounds) const;
+};
+
+/*****************************************************************/
+
+template<typename T>
+const uint32_t CSegmentGroupTable<T>::NONE;
+
+template<typename T>
+CSegmentGroupTable<T>::CSegmentGroupTable(const std::vector<std::vector<T>> & groups) :
+tableMask_(0), zeroGroup_(NONE)
+{
+  if (sizeof(T) <= 2) {
+    dense_.assign(size_t(1) << (8 * sizeof(T)), NONE);
+    for (size_t g = 0; g < groups.size(); ++g) {
+      for (auto it = groups[g].begin(); it != groups[g].end(); ++it) {
+        dense_[*it] = static_cast<uint32_t>(g);
+      }
+    }
+    return;
+  }
+
+  size_t labels = 0;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    labels += groups[g].size();
+  }
+
+  // Load factor <= 0.5, 0 marks an empty slot (label 0 is tracked by zeroGroup_)
+  size_t capacity = 16;
+  while (capacity < 2 * labels) {
+    capacity <<= 1;
+  }
+  keys_.assign(capacity, 0);
+  groups_.assign(capacity, NONE);
+  tableMask_ = capacity - 1;
+
+  for (size_t g = 0; g < groups.size(); ++g) {
+    for (auto it = groups[g].begin(); it != groups[g].end(); ++it) {
+      if (*it == 0) {
+        zeroGroup_ = static_cast<uint32_t>(g);
+        continue;
+      }
+      size_t i = hash(*it) & tableMask_;
+      while (keys_[i] != 0 && keys_[i] != *it) {
+        i = (i + 1) & tableMask_;
+      }
+      keys_[i] = *it;
+      groups_[i] = static_cast<uint32_t>(g);
+    }
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CSegmentGroupTable<T>::bounds(const T * volume, const zi::vl::vec<size_t, 3> & dim, size_t zBegin, size_t zEnd,
+                                   std::vector<CSelectionBounds> & bounds) const {
+  if (dim[0] < 3 || dim[1] < 3 || dim[2] < 3) {
+    return;
+  }
+
+  // Per row first/last hit of every group, groups hit in the current row are
+  // listed in `touched` so the y/z bounds are only updated once per row
+  std::vector<size_t> rowFirst(bounds.size()), rowLast(bounds.size()), rowCount(bounds.size(), 0);
+  std::vector<uint32_t> touched;
+
+  for (size_t z = std::max<size_t>(zBegin, 1); z < std::min(zEnd, dim[2] - 1); ++z) {
+    for (size_t y = 1; y < dim[1] - 1; ++y) {
+      const T * row = volume + dim[0] * (y + dim[1] * z);
+
+      T previous = row[0];
+      uint32_t g = group(previous);
+      for (size_t x = 1; x < dim[0] - 1; ++x) {
+        if (row[x] != previous) { // Labels come in runs, look up each run once
+          previous = row[x];
+          g = group(previous);
+        }
+        if (g == NONE) continue;
+
+        if (rowCount[g]++ == 0) {
+          rowFirst[g] = x;
+          touched.push_back(g);
+        }
+        rowLast[g] = x;
+      }
+
+      for (auto it = touched.begin(); it != touched.end(); ++it) {
+        CSelectionBounds & b = bounds[*it];
+        b.min[0] = std::min(b.min[0], rowFirst[*it]);
+        b.max[0] = std::max(b.max[0], rowLast[*it]);
+        b.min[1] = std::min(b.min[1], y);
+        b.max[1] = std::max(b.max[1], y);
+        b.min[2] = std::min(b.min[2], z);
+        b.max[2] = std::max(b.max[2], z);
+        b.voxels += rowCount[*it];
+        rowCount[*it] = 0;
+      }
+      touched.clear();
+    }
+  }
+}
+
+#endif
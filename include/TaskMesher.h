@@ -3,42 +3,350 @@
 #ifndef TASK_MESHER_H
 #define TASK_MESHER_H
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <set>
 #include <zi/vl/vec.hpp>
+#include <zi/mesh/int_mesh.hpp>
+#include <zi/mesh/quadratic_simplifier.hpp>
+
+#include "CompressedSegmentation.h"
+#include "MeshArena.h"
+#include "MeshCache.h"
+#include "MeshIO.h"
+#include "SegmentIndex.h"
+#include "SegmentMask.h"
+
+// Output formats, combined as a bit mask
+enum TaskMesherFormat {
+  TASKMESHER_FORMAT_DEGENERATE_STRIP = 1,  // float xyz + normal per strip vertex, see tri_strip_to_degenerate
+  TASKMESHER_FORMAT_INDEXED          = 2   // quantized indexed mesh, see CreateIndexedMesh
+};
+
+// When simplified LODs are generated
+enum TaskMesherLodMode {
+  TASKMESHER_LOD_EAGER      = 0,  // All LODs during generation
+  TASKMESHER_LOD_LAZY       = 1,  // Each LOD on its first GetMesh
+  TASKMESHER_LOD_BACKGROUND = 2   // Raw and first simplified LOD during generation, the rest on a background thread
+};
+
+// How the simplified LODs are sized, each with its own target in
+// CTaskMesherOptions::lodTargets. LODs without a target use the fixed ratios.
+enum TaskMesherLodPolicy {
+  TASKMESHER_LOD_POLICY_RATIO     = 0,  // Fixed face ratios, see LodSchedule
+  TASKMESHER_LOD_POLICY_ERROR     = 1,  // Max geometric error in voxels, bounds the simplifier's quadric error
+  TASKMESHER_LOD_POLICY_TRIANGLES = 2,  // Triangle budget
+  TASKMESHER_LOD_POLICY_BYTES     = 3   // Output bytes, all enabled formats together
+};
+
+// State of a job submitted to a CMesherEngine
+enum TaskMesherJobStatus {
+  TASKMESHER_JOB_PENDING   = 0,  // Queued
+  TASKMESHER_JOB_RUNNING   = 1,
+  TASKMESHER_JOB_DONE      = 2,  // Result ready to be taken
+  TASKMESHER_JOB_CANCELLED = 3,  // Cancelled or superseded, no result
+  TASKMESHER_JOB_FAILED    = 4,  // No result, e.g. out of memory
+  TASKMESHER_JOB_UNKNOWN   = 5   // Never submitted or already taken
+};
+
+// Outcome of a generation, see TaskMesher_GetStatus_*. Anything but OK
+// leaves the mesher without meshes.
+enum TaskMesherResult {
+  TASKMESHER_RESULT_OK          = 0,
+  TASKMESHER_RESULT_READ_FAILED = 1,  // Chunked input or mesh blob could not be read
+  TASKMESHER_RESULT_CANCELLED   = 2,  // Cancel token triggered
+  TASKMESHER_RESULT_TIMED_OUT   = 3,  // Time limit exceeded
+  TASKMESHER_RESULT_UNSUPPORTED = 4   // Options not available for the input (fillHoles with chunked input),
+                                      // or zi packs marching cubes vertices differently than assumed
+};
+
+// Cooperative cancellation: meshers check the token between units of work
+// (z-slabs while masking and marching, LODs while simplifying) and stop at
+// the next check. A token also counts as cancelled once its parent is.
+class CCancelToken {
+private:
+  std::atomic<bool>                 cancelled_;
+  const std::shared_ptr<const CCancelToken> parent_;
+
+public:
+  explicit CCancelToken(const std::shared_ptr<const CCancelToken> & parent = nullptr) : cancelled_(false), parent_(parent) {}
+
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+  bool IsCancelled() const { return cancelled_.load(std::memory_order_relaxed) || (parent_ && parent_->IsCancelled()); }
+};
+
+struct CTaskMesherOptions {
+  bool independentLods;   // Simplify every LOD from its own copy of the base mesh, in parallel
+  size_t threadCount;     // Threads used within one request (marching cubes slabs)
+  uint8_t outputFormats;  // TaskMesherFormat bit mask
+  uint8_t lodMode;        // TaskMesherLodMode, deferred modes always simplify sequentially
+  bool verbose;           // Print stage timings to stdout
+  size_t blockBytes;      // Chunked input: label bytes read per z-block
+  bool fillHoles;         // Mesh enclosed cavities as solid, not with chunked input
+  size_t previewDim[3];   // Nonzero: mesh a max-pooled downsampling of this size, vertices stay in task coordinates (not for chunked input)
+  CVertexTransform transform; // Applied to positions and normals while serializing, all formats
+  std::shared_ptr<const CCancelToken> cancelToken; // Checked while generating (deferred LODs included), may be null
+  double timeLimit;       // Seconds from the start of generation until it gives up, 0: none. LODs built after the constructor returns are exempt
+  uint8_t lodPolicy;      // TaskMesherLodPolicy
+  std::vector<double> lodTargets; // Target of LOD i + 1 under lodPolicy
+
+  CTaskMesherOptions() : independentLods(false), threadCount(1), outputFormats(TASKMESHER_FORMAT_DEGENERATE_STRIP),
+                         lodMode(TASKMESHER_LOD_EAGER), verbose(false), blockBytes(size_t(256) << 20), fillHoles(false), timeLimit(0.0),
+                         lodPolicy(TASKMESHER_LOD_POLICY_RATIO) {
+    previewDim[0] = previewDim[1] = previewDim[2] = 0;
+  }
+};
+
+// Chunked input: planes [zBegin, zBegin + zCount) of the task, copied into
+// `scratch` or owned by the reader. NULL on failure.
+template<typename T>
+using CBlockReader = std::function<const T * (size_t zBegin, size_t zCount, T * scratch)>;
+
+// Pipeline stages reported in TaskMesherStats
+enum TaskMesherStage {
+  TASKMESHER_STAGE_MASK           = 0,  // Bounding box scan and mask extraction
+  TASKMESHER_STAGE_MARCHING_CUBES = 1,  // Marching cubes and vertex welding
+  TASKMESHER_STAGE_PREPARE        = 2,  // fill_simplifier and quadrics/normals
+  TASKMESHER_STAGE_SIMPLIFY       = 3,  // optimize() of all LODs
+  TASKMESHER_STAGE_SERIALIZE      = 4,  // Stripification and output formats
+  TASKMESHER_STAGE_COUNT          = 5
+};
+
+// Per mesher counters, see TaskMesher_GetStats_*. 8 byte fields only, rtm.js
+// reads them by offset.
+struct TaskMesherStats {
+  double   wallTime[TASKMESHER_STAGE_COUNT];  // seconds the stage kept the mesher busy
+  double   cpuTime[TASKMESHER_STAGE_COUNT];   // seconds, all threads
+  uint64_t voxelsScanned;                     // label reads, bounding box scan and mask extraction
+  uint64_t voxelsSelected;
+  uint64_t mcTriangles;
+  uint64_t peakBytes;                         // large buffers only, simplifier estimated
+  uint64_t lodCount;                          // LODs built so far
+  uint64_t lodFaces[256];
+  uint64_t lodVertices[256];
+  uint64_t lodBytes[256];                     // all enabled output formats
+  double   lodAcmr[256];                      // indexed output, see AverageCacheMissRatio
+  double   lodStripVerticesPerTriangle[256];  // strip output, degenerate joins included
+};
+
+// Buffers a CMesherEngine worker reuses between jobs. Triangles, int_mesh
+// and the simplifier are allocated by zi for every job.
+struct CMesherScratch {
+  std::vector<uint8_t>              mask;    // Selection mask (bounding box of the selection)
+  std::vector<uint8_t>              preview; // Full preview grid while downsampling
+};
+
+// Serialized LOD, the buffers live in the mesher's arena (NULL if the format
+// is disabled or the LOD was cancelled)
+struct CMeshBuffers {
+  char                            * strip;
+  size_t                            stripBytes;
+  char                            * indexed;
+  size_t                            indexedBytes;
+  size_t                            faces;
+  size_t                            vertices;
+  double                            acmr;      // indexed output
+  double                            stripVerticesPerTriangle;
+  double                            cpuTime; // spent serializing
+
+  CMeshBuffers() : strip(NULL), stripBytes(0), indexed(NULL), indexedBytes(0), faces(0), vertices(0),
+                   acmr(0.0), stripVerticesPerTriangle(0.0), cpuTime(0.0) {}
+};
 
 template<typename T>
 class CTaskMesher {
 private:
-  std::vector<T>                    volume_;
+  std::vector<T>                    ownedVolume_;
+  const T                         * volume_; // ownedVolume_ or a borrowed caller buffer, NULL after masking
+  CBlockReader<T>                   reader_; // chunked input instead of volume_, reset after masking
+  CCompressedSegmentation           compressed_; // compressed input instead of volume_, reset after masking
+  const CSegmentIndex<T>          * index_;   // Borrowed for the duration of the constructor, may be NULL
+  std::vector<uint8_t>              occupied_; // index_ blocks holding selected voxels, while marching
+  std::atomic<uint8_t>              status_;   // TaskMesherResult, only ever leaves OK once
   bool                              meshed_;
+  const size_t                      knownVoxels_; // selected voxels if bboxMin_/bboxMax_ were given, else SIZE_MAX
+  CMesherScratch                  * scratch_;     // Reused buffers, may be NULL
+  const CTaskMesherOptions          options_;
+  std::chrono::steady_clock::time_point deadline_; // only if options_.timeLimit > 0
   const zi::vl::vec<size_t, 3>      dim_;
   std::set<T>                       segments_;
+  CSegmentMask<T>                   lookup_;
   uint8_t                           miplevels_;
 
+  zi::vl::vec<size_t, 3>            bboxMin_; // inclusive bounds of the selected voxels
+  zi::vl::vec<size_t, 3>            bboxMax_;
+
+  // Maps the marched (doubled) lattice to task coordinates, x y z. Identity
+  // unless a preview was downsampled.
+  double                            vertexScale_[3];
+  double                            vertexOffset_[3];
+
 
   size_t                            meshLength_[256];
   char                            * meshData_[256];
+  size_t                            indexedLength_[256];
+  char                            * indexedData_[256];
+  CMeshArena                        arena_; // Holds the buffers above, released all at once
+  std::shared_ptr<const CMeshBlob>  blob_; // Loaded meshers: the buffers above point into it instead
+
+  // Deferred LODs: simplifier_ stays at the last built LOD (builderMutex_),
+  // stateMutex_ guards nextLod_, pendingScale_ and the mesh buffers.
+  std::unique_ptr<zi::mesh::simplifier<double>> simplifier_;
+  int                               nextLod_;
+  float                             pendingScale_[3];
+  std::mutex                        builderMutex_;
+  mutable std::mutex                stateMutex_;
+  std::thread                       background_;
+
+  // Guarded by stateMutex_ once a background thread may be running
+  TaskMesherStats                   stats_;
+  int64_t                           trackedBytes_;
+
+  CTaskMesher(const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+              const CTaskMesherOptions & options, CMesherScratch * scratch, const CSelectionBounds * bounds);
+  void build(bool validInput, TaskMesherResult invalidResult = TASKMESHER_RESULT_READ_FAILED);
+  void init();
+  void generate();
+  void releaseVolume();
+  bool aborted(bool checkDeadline = true);
+  void abort(TaskMesherResult reason);
+  void discardMeshes();
+  void ownMeshes();
 
-  inline void idxToXYZ(size_t idx, size_t &x, size_t &y, size_t &z) const;
+  void cropBounds(const zi::vl::vec<size_t, 3> & dim, zi::vl::vec<size_t, 3> & origin, zi::vl::vec<size_t, 3> & extent) const;
+  void fillHoles(std::vector<uint8_t> & mask, const zi::vl::vec<size_t, 3> & extent) const;
+  bool selectSegments(std::vector<uint8_t> & mask, zi::vl::vec<size_t, 3> & origin,
+                      zi::vl::vec<size_t, 3> & extent, bool fillHoles = false);
+  bool downsampleSegments(std::vector<uint8_t> & mask, zi::vl::vec<size_t, 3> & origin,
+                          zi::vl::vec<size_t, 3> & extent, bool fillHoles = false);
+  bool extractOccupied(std::vector<uint8_t> & mask, const zi::vl::vec<size_t, 3> & origin, const zi::vl::vec<size_t, 3> & extent);
+  bool occupiedRect(const zi::vl::vec<size_t, 3> & origin, const zi::vl::vec<size_t, 3> & extent, size_t zBegin, size_t zEnd,
+                    size_t & xBegin, size_t & xEnd, size_t & yBegin, size_t & yEnd) const;
+  bool selectCompressed(std::vector<uint8_t> & mask, zi::vl::vec<size_t, 3> & origin,
+                        zi::vl::vec<size_t, 3> & extent, bool preview, bool fillHoles = false);
+  size_t gridBounds(const uint8_t * grid, const zi::vl::vec<size_t, 3> & size);
+  bool previewCells(zi::vl::vec<size_t, 3> & previewDim, std::vector<size_t> cells[3]);
+  void cropPreview(const std::vector<uint8_t> & preview, const zi::vl::vec<size_t, 3> & previewDim, std::vector<uint8_t> & mask,
+                   zi::vl::vec<size_t, 3> & origin, zi::vl::vec<size_t, 3> & extent) const;
 
-  void selectSegmentsFillHoles();
-  void selectSegmentsLeaveHoles();
-  void selectSegments(bool fillHoles = false);
+  size_t marchBlock(const std::vector<uint8_t> & block, const zi::vl::vec<size_t, 3> & origin,
+                    const zi::vl::vec<size_t, 3> & extent, zi::mesh::int_mesh & im, double & workerCpu);
+  size_t marchChunked(zi::mesh::int_mesh & im);
+  void buildLodsPipelined(zi::mesh::simplifier<double> & s);
+  void buildLodsIndependent(zi::mesh::simplifier<double> & base);
+  void lodTarget(int lod, size_t faceCount, double bytesPerFace, size_t & targetFaces, double & maxError) const;
+  double lodByteBudget(int lod) const;
+  CMeshBuffers serializeLod(zi::mesh::simplifier<double> & s, int lod, bool checkDeadline = true);
+  void storeMesh(int lod, const CMeshBuffers & buffers);
+  void buildLod(int lod, bool checkDeadline = false);
+  bool isBuilt(int lod) const;
+  void scaleLod(int lod, const float scaleFactor[3]);
+  void recordStage(TaskMesherStage stage, double wallTime, double cpuTime);
+  void trackBytes(int64_t bytes);
 
 
 public:
   static const char * empty_mesh;
-  bool GetMesh(uint8_t lod, const char ** data, size_t * length) const;
+  // Builds the LOD first if its generation was deferred (blocks until ready)
+  bool GetMesh(uint8_t lod, const char ** data, size_t * length);
+  bool GetIndexedMesh(uint8_t lod, const char ** data, size_t * length);
   void ScaleMesh(float scaleFactor[3]);
+  TaskMesherStats GetStats() const;
+
+  CTaskMesher(std::vector<T> segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+              const CTaskMesherOptions & options = CTaskMesherOptions());
+
+  // Borrows `segmentation` until the constructor returns, `scratch` lends
+  // reusable buffers.
+  CTaskMesher(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+              const CTaskMesherOptions & options = CTaskMesherOptions(), CMesherScratch * scratch = NULL);
+
+  // Borrowed labels with the selection bounds already known (see
+  // CSegmentGroupTable::bounds), skips the bounding box scan.
+  CTaskMesher(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+              const CSelectionBounds & bounds, const CTaskMesherOptions & options = CTaskMesherOptions());
+
+  // Reads the labels in z-blocks of about options.blockBytes, same mesh as in
+  // place. UNSUPPORTED with options.fillHoles.
+  CTaskMesher(const CBlockReader<T> & reader, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+              const CTaskMesherOptions & options = CTaskMesherOptions());
+
+  // Borrowed labels, only the index blocks holding the segments are masked
+  // and marched. READ_FAILED if the index is invalid.
+  CTaskMesher(const T * segmentation, const CSegmentIndex<T> & index, const std::vector<T> & segments, uint8_t mipCount,
+              const CTaskMesherOptions & options = CTaskMesherOptions(), CMesherScratch * scratch = NULL);
+
+  // Borrowed compressed labels, decoded straight into the mask. READ_FAILED
+  // if the encoding is invalid.
+  CTaskMesher(const CCompressedSegmentation & segmentation, const std::vector<T> & segments, uint8_t mipCount,
+              const CTaskMesherOptions & options = CTaskMesherOptions(), CMesherScratch * scratch = NULL);
+
+  // Serves the meshes of a blob written by Serialize in place. READ_FAILED
+  // unless it is valid and matches `key` and T.
+  CTaskMesher(const std::shared_ptr<const CMeshBlob> & blob, uint64_t key);
 
-  CTaskMesher(std::vector<T> segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount);
+  TaskMesherResult GetStatus() const { return TaskMesherResult(status_.load()); }
+  // True if a block could not be read, the mesh is empty then
+  bool ReadFailed() const { return GetStatus() == TASKMESHER_RESULT_READ_FAILED; }
+
+  // Writes all LODs (building deferred ones first) as returned by GetMesh and
+  // GetIndexedMesh, ScaleMesh included. False unless the status is OK.
+  bool Serialize(uint64_t key, std::vector<char> & blob);
   ~CTaskMesher();
 
 };
 
+// Cache key of a mesh blob: labels, sorted segments and the options that
+// change the meshes.
+template<typename T>
+uint64_t MeshCacheKey(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options = CTaskMesherOptions());
+// Same for compressed labels, hashes the encoded words instead. The key
+// differs from the one of the decoded volume.
+template<typename T>
+uint64_t MeshCacheKey(const CCompressedSegmentation & segmentation, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options = CTaskMesherOptions());
+
+// Meshes disjoint segment groups of one volume after a single bounds scan,
+// options.threadCount groups at a time.
+template<typename T>
+class CTaskMesherBatch {
+private:
+  std::vector<std::unique_ptr<CTaskMesher<T>>> meshers_;
+
+public:
+  // Borrows `segmentation` like the in-place CTaskMesher. The groups must be
+  // disjoint (see Disjoint), options apply to every group's mesher.
+  CTaskMesherBatch(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<std::vector<T>> & groups, uint8_t mipCount,
+                   const CTaskMesherOptions & options = CTaskMesherOptions());
+
+  size_t Size() const { return meshers_.size(); }
+  // Owned by the batch
+  CTaskMesher<T> * GetMesher(size_t group) const { return meshers_[group].get(); }
+
+  static bool Disjoint(const std::vector<std::vector<T>> & groups);
+};
+
 typedef struct TaskMeshHandle TMesher;
+typedef struct TaskMeshBatchHandle TMesherBatch;
+typedef struct TaskMeshOptionsHandle TMesherOptions;
+typedef struct TaskMeshEngineHandle TMesherEngine;
+typedef struct TaskMeshCancelHandle TMesherCancelToken;
+typedef struct TaskMeshIndexHandle TMesherIndex;
+
+// Chunked input: copies planes [zBegin, zBegin + zCount) of the task (x
+// fastest, then y) into `buffer` and returns nonzero on success.
+typedef int (*TaskMesherReadPlanes)(void * userData, size_t zBegin, size_t zCount, unsigned char * buffer);
+
+// Engine jobs: called from a worker thread once `job` is final (a
+// TaskMesherJobStatus other than PENDING and RUNNING).
+typedef void (*TaskMesherJobDone)(void * userData, uint64_t job, uint8_t status);
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +354,133 @@ extern "C" {
   TMesher * TaskMesher_Generate_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount);
   TMesher * TaskMesher_Generate_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount);
   TMesher * TaskMesher_Generate_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount);
+  TMesher * TaskMesher_GenerateWithOptions_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateWithOptions_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateWithOptions_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  // Zero-copy variants: `volume` is only read until the call returns.
+  // `options` may be NULL.
+  TMesher * TaskMesher_GenerateInPlace_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateInPlace_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateInPlace_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  // Chunked variants, see TaskMesher_SetBlockBytes. FromFile maps a raw label
+  // file. NULL if reading fails.
+  TMesher * TaskMesher_GenerateChunked_uint8(TaskMesherReadPlanes read, void * userData, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateChunked_uint16(TaskMesherReadPlanes read, void * userData, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateChunked_uint32(TaskMesherReadPlanes read, void * userData, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateFromFile_uint8(const char * path, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateFromFile_uint16(const char * path, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateFromFile_uint32(const char * path, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  // Compressed variants: one channel of compressed_segmentation with 4 or 8
+  // byte labels, borrowed like in GenerateInPlace. NULL if it is invalid.
+  TMesher * TaskMesher_GenerateCompressed_uint8(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateCompressed_uint16(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateCompressed_uint32(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  // uint32 compressed_segmentation, NULL if too large. Free the result with
+  // TaskMesher_ReleaseCompressed.
+  const unsigned char * TaskMesher_CompressSegmentation_uint8(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length);
+  const unsigned char * TaskMesher_CompressSegmentation_uint16(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length);
+  const unsigned char * TaskMesher_CompressSegmentation_uint32(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length);
+  void      TaskMesher_ReleaseCompressed(const unsigned char * data);
+  // Segment index, see CSegmentIndex. Serialize returns the size and writes
+  // only if `capacity` suffices, LoadIndex returns NULL if it is malformed.
+  TMesherIndex * TaskMesher_CreateIndex_uint8(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount);
+  TMesherIndex * TaskMesher_CreateIndex_uint16(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount);
+  TMesherIndex * TaskMesher_CreateIndex_uint32(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount);
+  size_t    TaskMesher_SerializeIndex_uint8(TMesherIndex * index, unsigned char * buffer, size_t capacity);
+  size_t    TaskMesher_SerializeIndex_uint16(TMesherIndex * index, unsigned char * buffer, size_t capacity);
+  size_t    TaskMesher_SerializeIndex_uint32(TMesherIndex * index, unsigned char * buffer, size_t capacity);
+  TMesherIndex * TaskMesher_LoadIndex_uint8(const unsigned char * data, size_t length);
+  TMesherIndex * TaskMesher_LoadIndex_uint16(const unsigned char * data, size_t length);
+  TMesherIndex * TaskMesher_LoadIndex_uint32(const unsigned char * data, size_t length);
+  void      TaskMesher_ReleaseIndex_uint8(TMesherIndex * index);
+  void      TaskMesher_ReleaseIndex_uint16(TMesherIndex * index);
+  void      TaskMesher_ReleaseIndex_uint32(TMesherIndex * index);
+  // Indexed variants: like GenerateInPlace for the index's volume, NULL if
+  // the index is invalid.
+  TMesher * TaskMesher_GenerateIndexed_uint8(unsigned char * volume, TMesherIndex * index, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateIndexed_uint16(unsigned char * volume, TMesherIndex * index, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GenerateIndexed_uint32(unsigned char * volume, TMesherIndex * index, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  // Batch variants: `segments` holds the groups back to back, NULL if a label
+  // is in two groups. Batch meshers are released with their batch.
+  TMesherBatch * TaskMesher_GenerateBatch_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint32_t * groupSizes, uint32_t groupCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesherBatch * TaskMesher_GenerateBatch_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint32_t * groupSizes, uint32_t groupCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesherBatch * TaskMesher_GenerateBatch_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t * groupSizes, uint32_t groupCount, uint8_t mipCount, const TMesherOptions * options);
+  TMesher * TaskMesher_GetBatchMesher_uint8(TMesherBatch * batch, uint32_t group);
+  TMesher * TaskMesher_GetBatchMesher_uint16(TMesherBatch * batch, uint32_t group);
+  TMesher * TaskMesher_GetBatchMesher_uint32(TMesherBatch * batch, uint32_t group);
+  void      TaskMesher_ReleaseBatch_uint8(TMesherBatch * batch);
+  void      TaskMesher_ReleaseBatch_uint16(TMesherBatch * batch);
+  void      TaskMesher_ReleaseBatch_uint32(TMesherBatch * batch);
+  // Engine: threadCount workers (0: one per core), highest priority first.
+  // Release drops queued jobs and frees untaken results.
+  TMesherEngine * TaskMesher_CreateEngine(uint8_t threadCount, TaskMesherJobDone done, void * userData);
+  void      TaskMesher_ReleaseEngine(TMesherEngine * engine);
+  // Queues GenerateInPlace, `volume` stays borrowed until the job is final.
+  // A nonzero `key` cancels unfinished jobs with the same key.
+  uint64_t  TaskMesher_Submit_uint8(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint64_t  TaskMesher_Submit_uint16(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint64_t  TaskMesher_Submit_uint32(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  // Same for compressed labels (see GenerateCompressed), invalid encodings
+  // make the job FAILED
+  uint64_t  TaskMesher_SubmitCompressed_uint8(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint64_t  TaskMesher_SubmitCompressed_uint16(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint64_t  TaskMesher_SubmitCompressed_uint32(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  // Same with a segment index (see GenerateIndexed), volume and index must
+  // stay valid until the job is final
+  uint64_t  TaskMesher_SubmitIndexed_uint8(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint64_t  TaskMesher_SubmitIndexed_uint16(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint64_t  TaskMesher_SubmitIndexed_uint32(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+  uint8_t   TaskMesher_PollJob(TMesherEngine * engine, uint64_t job);
+  // Returns 0 if the job is unknown or already final
+  uint8_t   TaskMesher_CancelJob(TMesherEngine * engine, uint64_t job);
+  // Forgets a final job. Returns its mesher if it is DONE (release it with
+  // the TaskMesher_Release_* of the submitted type), NULL otherwise.
+  TMesher * TaskMesher_TakeJob(TMesherEngine * engine, uint64_t job);
+  // Mesh cache: SaveCache returns 0 on failure, LoadCache maps the file and
+  // returns NULL unless it is valid and matches `key`.
+  uint64_t  TaskMesher_CacheKey_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  uint64_t  TaskMesher_CacheKey_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  uint64_t  TaskMesher_CacheKey_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  // Key of compressed labels, differs from the key of the decoded volume
+  uint64_t  TaskMesher_CacheKeyCompressed_uint8(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  uint64_t  TaskMesher_CacheKeyCompressed_uint16(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  uint64_t  TaskMesher_CacheKeyCompressed_uint32(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+  uint8_t   TaskMesher_SaveCache_uint8(TMesher * taskmesher, uint64_t key, const char * path);
+  uint8_t   TaskMesher_SaveCache_uint16(TMesher * taskmesher, uint64_t key, const char * path);
+  uint8_t   TaskMesher_SaveCache_uint32(TMesher * taskmesher, uint64_t key, const char * path);
+  TMesher * TaskMesher_LoadCache_uint8(const char * path, uint64_t key);
+  TMesher * TaskMesher_LoadCache_uint16(const char * path, uint64_t key);
+  TMesher * TaskMesher_LoadCache_uint32(const char * path, uint64_t key);
+  TMesherOptions * TaskMesher_CreateOptions();
+  void      TaskMesher_ReleaseOptions(TMesherOptions * options);
+  void      TaskMesher_SetIndependentLods(TMesherOptions * options, uint8_t enable);
+  void      TaskMesher_SetThreadCount(TMesherOptions * options, uint8_t threadCount);
+  void      TaskMesher_SetOutputFormats(TMesherOptions * options, uint8_t formats);
+  void      TaskMesher_SetLodMode(TMesherOptions * options, uint8_t lodMode);
+  void      TaskMesher_SetVerbose(TMesherOptions * options, uint8_t enable);
+  void      TaskMesher_SetBlockBytes(TMesherOptions * options, size_t bytes);
+  void      TaskMesher_SetFillHoles(TMesherOptions * options, uint8_t enable);
+  // Meshes a preview of previewDim voxels (any selected voxel in a cell
+  // selects it), vertices are in task coordinates. {0, 0, 0} disables it.
+  void      TaskMesher_SetPreview(TMesherOptions * options, size_t previewDim[3]);
+  // Row-major 3x4 [linear | offset], see CVertexTransform. Voxel resolution r
+  // and offset o: { r.x / 2, 0, 0, o.x,  0, r.y / 2, 0, o.y,  0, 0, r.z / 2, o.z }
+  void      TaskMesher_SetTransform(TMesherOptions * options, float affine[12]);
+  // Meshers report CANCELLED at their next check once the token is
+  // cancelled. It may be released at any time.
+  TMesherCancelToken * TaskMesher_CreateCancelToken();
+  void      TaskMesher_CancelToken(TMesherCancelToken * token);
+  void      TaskMesher_ReleaseCancelToken(TMesherCancelToken * token);
+  void      TaskMesher_SetCancelToken(TMesherOptions * options, TMesherCancelToken * token);
+  // Gives up with TASKMESHER_RESULT_TIMED_OUT after `seconds`, 0 disables it
+  void      TaskMesher_SetTimeLimit(TMesherOptions * options, double seconds);
+  // One target per simplified LOD (targets[0] for LOD 1), LODs past `count`
+  // use the fixed ratios.
+  void      TaskMesher_SetLodPolicy(TMesherOptions * options, uint8_t policy, const double * targets, uint8_t count);
+  // TaskMesherResult of the generation
+  uint8_t   TaskMesher_GetStatus_uint8(TMesher * taskmesher);
+  uint8_t   TaskMesher_GetStatus_uint16(TMesher * taskmesher);
+  uint8_t   TaskMesher_GetStatus_uint32(TMesher * taskmesher);
   void      TaskMesher_Release_uint8(TMesher * taskmesher);
   void      TaskMesher_Release_uint16(TMesher * taskmesher);
   void      TaskMesher_Release_uint32(TMesher * taskmesher);
@@ -55,12 +490,23 @@ extern "C" {
   void      TaskMesher_GetSimplifiedMesh_uint8(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length);
   void      TaskMesher_GetSimplifiedMesh_uint16(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length);
   void      TaskMesher_GetSimplifiedMesh_uint32(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length);
+  void      TaskMesher_GetRawIndexedMesh_uint8(TMesher * taskmesher, const char ** data, size_t * length);
+  void      TaskMesher_GetRawIndexedMesh_uint16(TMesher * taskmesher, const char ** data, size_t * length);
+  void      TaskMesher_GetRawIndexedMesh_uint32(TMesher * taskmesher, const char ** data, size_t * length);
+  void      TaskMesher_GetSimplifiedIndexedMesh_uint8(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length);
+  void      TaskMesher_GetSimplifiedIndexedMesh_uint16(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length);
+  void      TaskMesher_GetSimplifiedIndexedMesh_uint32(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length);
   void      TaskMesher_ScaleVolume_uint8(unsigned char * in_volume, size_t from_dim[3], size_t to_dim[3], unsigned char * out_buffer);
   void      TaskMesher_ScaleVolume_uint16(unsigned char * in_volume, size_t from_dim[3], size_t to_dim[3], unsigned char * out_buffer);
   void      TaskMesher_ScaleVolume_uint32(unsigned char * in_volume, size_t from_dim[3], size_t to_dim[3], unsigned char * out_buffer);
+  // Scales the finished and all later LODs, normals included
   void      TaskMesher_ScaleMesh_uint8(TMesher * taskmesher, float scaleFactor[3]);
   void      TaskMesher_ScaleMesh_uint16(TMesher * taskmesher, float scaleFactor[3]);
   void      TaskMesher_ScaleMesh_uint32(TMesher * taskmesher, float scaleFactor[3]);
+  // Snapshot of the counters so far. LODs that are still deferred are not included.
+  void      TaskMesher_GetStats_uint8(TMesher * taskmesher, TaskMesherStats * stats);
+  void      TaskMesher_GetStats_uint16(TMesher * taskmesher, TaskMesherStats * stats);
+  void      TaskMesher_GetStats_uint32(TMesher * taskmesher, TaskMesherStats * stats);
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -5,8 +5,19 @@
 #include <zi/mesh/quadratic_simplifier.hpp>
 #include <zi/timer.hpp>
 
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <fstream>
-#include <queue>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 /*****************************************************************/
 template<typename T>
@@ -17,9 +28,6 @@ const char * CTaskMesher<T>::empty_mesh = "";
 template<typename T>
 void ScaleVolume(const T * org_buf, size_t from_dim[3], size_t to_dim[3], T * scaled_buf)
 {
-  std::cout << "Downscaling from [" << from_dim[0] << "," << from_dim[1] << "," << from_dim[2] << "] to [" <<
-    to_dim[0] << "," << to_dim[1] << "," << to_dim[2] << "]\n";
-
   zi::vl::vec<float, 3> scaleFactor(
     (float)from_dim[0] / (float)to_dim[0],
     (float)from_dim[1] / (float)to_dim[1],
@@ -40,233 +48,1871 @@ void ScaleVolume(const T * org_buf, size_t from_dim[3], size_t to_dim[3], T * sc
 
 /*****************************************************************/
 
+// zi::mesh::marching_cubes emits vertices on the doubled voxel lattice (so
+// edge midpoints are integral) and packs them as x << 40 | y << 20 | z, where
+// x is the slowest varying axis of the volume passed to marche().
+template<typename Triangle>
+void TranslateTriangles(std::vector<Triangle> & triangles, uint64_t x, uint64_t y, uint64_t z)
+{
+  const uint64_t offset = ((2 * x) << 40) | ((2 * y) << 20) | (2 * z);
+  if (offset == 0) {
+    return;
+  }
+
+  for (auto tri = triangles.begin(); tri != triangles.end(); ++tri) {
+    (*tri)[0] += offset;
+    (*tri)[1] += offset;
+    (*tri)[2] += offset;
+  }
+}
+
+// Triangle list type returned by zi::mesh::marching_cubes<T>
 template<typename T>
-void CTaskMesher<T>::ScaleMesh(float scaleFactor[3])
+using MCTriangles = typename std::decay<decltype(std::declval<zi::mesh::marching_cubes<T> &>().get_triangles(T()))>::type;
+
+// Checks TranslateTriangles against zi: a voxel marched at (1, 1, 1) of a
+// 3x3x3 block and moved by (1, 2, 3) has to give the triangles of the same
+// voxel at (2, 3, 4) of a 4x5x6 block.
+inline bool PackedVertexLayoutMatches()
 {
-  for (int lod = 0; lod < 1 + miplevels_; ++lod) {
-    if (meshData_[lod]) {
-      float * data = (float*)(meshData_[lod]);
-      int length = meshLength_[lod] / sizeof(float);
-      
-      for (int i = 0; i < length; i += 6) {
-        data[i + 0] *= scaleFactor[0];
-        data[i + 1] *= scaleFactor[1];
-        data[i + 2] *= scaleFactor[2];
-        // 3, 4, 5 are the vertex normal
-      }
+  std::vector<uint8_t> small(3 * 3 * 3, 0), large(4 * 5 * 6, 0);
+  small[1 + 3 * (1 + 3 * 1)] = 1;
+  large[4 + 6 * (3 + 5 * 2)] = 1;
+
+  zi::mesh::marching_cubes<uint8_t> a, b;
+  a.marche(small.data(), 3, 3, 3);
+  b.marche(large.data(), 4, 5, 6);
+  if (a.count(1) == 0 || a.count(1) != b.count(1)) {
+    return false;
+  }
+
+  MCTriangles<uint8_t> moved = a.get_triangles(1);
+  TranslateTriangles(moved, 1, 2, 3);
+  const MCTriangles<uint8_t> expected = b.get_triangles(1);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (moved[i][0] != expected[i][0] || moved[i][1] != expected[i][1] || moved[i][2] != expected[i][2]) {
+      return false;
     }
   }
+  return true;
 }
 
 /*****************************************************************/
 
-template<typename T>
-CTaskMesher<T>::CTaskMesher(std::vector<T> segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t miplevels) :
-volume_(std::move(segmentation)), meshed_(false), dim_(dim), segments_(segments.begin(), segments.end()), miplevels_(miplevels)
+// Fixed LOD schedule (TASKMESHER_LOD_POLICY_RATIO): an initial (lossless)
+// reduction to a tenth of the faces, then every further level removes another
+// 7/8th with growing error tolerance.
+inline void LodSchedule(int mip, size_t faceCount, size_t & targetFaces, double & maxError)
 {
-    for (int i = 0; i < 1 + miplevels_; ++i) {
-      meshData_[i] = NULL;
-    }
+  if (mip == 0) {
+    targetFaces = faceCount / 10;
+    maxError = 1e-12;
+  } else {
+    targetFaces = faceCount / 8;
+    maxError = 1 << (10 * (mip - 1));
+  }
+}
 
-    if (segments_.empty()) { // Shortcut for empty tasks
-        meshed_ = true;
-        return;
+// Byte budgets: output size per face assumed until a level of the mesher has
+// been serialized (strips about 2 vertices, indexed about half a vertex per
+// face), and the most serializations spent on fitting one level
+inline double EstimatedBytesPerFace(uint8_t formats)
+{
+  return (formats & TASKMESHER_FORMAT_DEGENERATE_STRIP ? 2.0 * 6 * sizeof(float) : 0.0) +
+         (formats & TASKMESHER_FORMAT_INDEXED ? 3 * sizeof(uint16_t) + 0.5 * 8 : 0.0);
+}
+// Measured on a serialized level if it has faces
+inline double BytesPerFace(uint64_t bytes, uint64_t faces, uint8_t formats)
+{
+  return faces > 0 && bytes > 0 ? double(bytes) / double(faces) : EstimatedBytesPerFace(formats);
+}
+const int TASKMESHER_BUDGET_PASSES = 4;
+
+// Planes masked or marched between two checks for cancellation
+const size_t TASKMESHER_CHECK_PLANES = 32;
+
+/*****************************************************************/
+
+// CPU time consumed by the calling thread, in seconds
+inline double ThreadCpuTime()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Wall and calling thread CPU time since construction or reset()
+class CStageTimer {
+private:
+  zi::wall_timer wall_;
+  double         cpu_;
+
+public:
+  CStageTimer() { reset(); }
+  void reset() { wall_.reset(); cpu_ = ThreadCpuTime(); }
+  double wall() const { return wall_.elapsed<double>(); }
+  double cpu() const { return ThreadCpuTime() - cpu_; }
+};
+
+// Estimated footprint of a simplifier holding `faces` faces: the face indices
+// plus, at about half as many vertices as faces, point, normal and quadric.
+inline int64_t SimplifierBytes(size_t faces)
+{
+  return faces * (sizeof(vec3u) + (2 * sizeof(zi::vl::vec3d) + 10 * sizeof(double)) / 2);
+}
+
+/*****************************************************************/
+
+inline CMeshBuffers SerializeMesh(zi::mesh::simplifier<double> & s, uint8_t formats, const CVertexTransform * transform,
+                                  CMeshArena & arena)
+{
+  const double cpu = ThreadCpuTime();
+
+  CMeshBuffers buffers;
+  buffers.faces = s.face_count();
+  if (formats & TASKMESHER_FORMAT_DEGENERATE_STRIP) {
+    buffers.strip = CreateDegTriStrip(s, arena, &buffers.stripBytes, &buffers.vertices, transform);
+    if (buffers.faces > 0) {
+      buffers.stripVerticesPerTriangle = double(buffers.stripBytes / (6 * sizeof(float))) / double(buffers.faces);
     }
+  }
+  if (formats & TASKMESHER_FORMAT_INDEXED) {
+    buffers.indexed = CreateIndexedMesh(s, arena, &buffers.indexedBytes, &buffers.vertices, transform, &buffers.acmr);
+  }
 
-    zi::wall_timer t;
-    t.reset();
+  buffers.cpuTime = ThreadCpuTime() - cpu;
+  return buffers;
+}
 
-    // 3. Mask and Merge Segments
-    selectSegments(false);
+/*****************************************************************/
 
-    std::cout << "Masking segmentation data: " << t.elapsed<double>() << " s\n";
-    t.reset();
-    
-    // 4. Run Marching Cubes
-    zi::mesh::marching_cubes<T> mc;
-    mc.marche(&volume_[0], dim_[2], dim_[1], dim_[0]);
+template<typename T>
+void CTaskMesher<T>::ScaleMesh(float scaleFactor[3])
+{
+  std::lock_guard<std::mutex> state(stateMutex_);
+  ownMeshes();
 
-    std::cout << "Marching Cubes: " << t.elapsed<double>() << " s\n";
-    t.reset();
+  for (int lod = 0; lod < std::min<int>(nextLod_, 1 + miplevels_); ++lod) {
+    scaleLod(lod, scaleFactor);
+  }
 
-    // 5. Mesh Cleanup and Simplification
-    if (mc.count(1) > 0) {
-        std::vector<float> strip;
-        zi::mesh::int_mesh im;
-        im.add(mc.get_triangles(1));
+  // LODs that are generated later are scaled when they are stored
+  for (int i = 0; i < 3; ++i) {
+    pendingScale_[i] *= scaleFactor[i];
+  }
+}
 
-        zi::mesh::simplifier<double> s;
-        im.fill_simplifier<double>(s);
-        s.prepare();
+/*****************************************************************/
 
-        std::cout << "Quadrics and Normal calculation." << t.elapsed<double>() << " s\n";
-        t.reset();
+template<typename T>
+void CTaskMesher<T>::scaleLod(int lod, const float scaleFactor[3])
+{
+  const CVertexTransform scale = CVertexTransform::Scale(scaleFactor);
 
-        strip = CreateDegTriStrip(s);
-        meshLength_[0] = strip.size() * sizeof(float);
-        meshData_[0] = new char[meshLength_[0]];
-        memcpy(meshData_[0], reinterpret_cast<const char*>(&strip[0]), meshLength_[0]);
+  if (meshData_[lod]) {
+    TransformDegTriStrip(reinterpret_cast<float *>(meshData_[lod]), meshLength_[lod] / (6 * sizeof(float)), scale);
+  }
 
-        std::cout << "Original MC mesh, no simplification: " << t.elapsed<double>() << " s\n";
-        t.reset();
+  if (indexedData_[lod]) {
+    TransformIndexedMesh(indexedData_[lod], scale);
+  }
+}
 
-        if (miplevels_ == 0) {
-          return;
-        }
+/*****************************************************************/
 
-        s.optimize(s.face_count() / 10, 1e-12);
-        strip = CreateDegTriStrip(s);
-        meshLength_[1] = strip.size() * sizeof(float);
-        meshData_[1] = new char[meshLength_[1]];
-        memcpy(meshData_[1], reinterpret_cast<const char*>(&strip[0]), meshLength_[1]);
+template<typename T>
+TaskMesherStats CTaskMesher<T>::GetStats() const
+{
+  std::lock_guard<std::mutex> state(stateMutex_);
+  return stats_;
+}
 
-        std::cout << "Initial (lossless) simplification: " << t.elapsed<double>() << " s\n";
-        t.reset();
+/*****************************************************************/
 
-        for (int mip = 1; mip < miplevels_; ++mip) {
-          s.optimize(s.face_count() / 8, 1 << (10*(mip - 1)));
-          strip = CreateDegTriStrip(s);
-          meshLength_[1 + mip] = strip.size() * sizeof(float);
-          meshData_[1 + mip] = new char[meshLength_[1 + mip]];
-          memcpy(meshData_[1 + mip], reinterpret_cast<const char*>(&strip[0]), meshLength_[1 + mip]);
+template<typename T>
+void CTaskMesher<T>::recordStage(TaskMesherStage stage, double wallTime, double cpuTime)
+{
+  stats_.wallTime[stage] += wallTime;
+  stats_.cpuTime[stage] += cpuTime;
+}
 
-          std::cout << "Simplification " << std::to_string(mip) << ": " << t.elapsed<double>() << " s\n";
-          t.reset();
-        }
-    }
+template<typename T>
+void CTaskMesher<T>::trackBytes(int64_t bytes)
+{
+  trackedBytes_ += bytes;
+  stats_.peakBytes = std::max<uint64_t>(stats_.peakBytes, std::max<int64_t>(trackedBytes_, 0));
 }
 
 /*****************************************************************/
 
+// Checks the cancel token and, unless `checkDeadline` is false (deferred LODs
+// built after the constructor), the time limit. Once generation failed for
+// any reason the status sticks and every later check fails. Called from
+// worker threads as well.
 template<typename T>
-CTaskMesher<T>::~CTaskMesher()
+bool CTaskMesher<T>::aborted(bool checkDeadline)
+{
+  if (status_.load(std::memory_order_relaxed) == TASKMESHER_RESULT_OK) {
+    if (options_.cancelToken && options_.cancelToken->IsCancelled()) {
+      abort(TASKMESHER_RESULT_CANCELLED);
+    } else if (checkDeadline && options_.timeLimit > 0.0 && std::chrono::steady_clock::now() > deadline_) {
+      abort(TASKMESHER_RESULT_TIMED_OUT);
+    }
+  }
+  return status_.load(std::memory_order_relaxed) != TASKMESHER_RESULT_OK;
+}
+
+// Keeps the first failure
+template<typename T>
+void CTaskMesher<T>::abort(TaskMesherResult reason)
+{
+  uint8_t ok = TASKMESHER_RESULT_OK;
+  status_.compare_exchange_strong(ok, reason);
+}
+
+// Frees everything built so far, GetMesh returns empty meshes after a failure
+template<typename T>
+void CTaskMesher<T>::discardMeshes()
 {
+  if (simplifier_) {
+    simplifier_.reset();
+    trackBytes(-SimplifierBytes(stats_.mcTriangles));
+  }
+
   for (int i = 0; i < 1 + miplevels_; ++i) {
-    delete[] meshData_[i];
     meshData_[i] = NULL;
+    indexedData_[i] = NULL;
   }
+  arena_.release();
+}
+
+// Copies the buffers of a loaded mesher out of its (read-only) blob before
+// they are modified. Requires stateMutex_.
+template<typename T>
+void CTaskMesher<T>::ownMeshes()
+{
+  if (!blob_) {
+    return;
+  }
+
+  for (int i = 0; i < 1 + miplevels_; ++i) {
+    if (meshData_[i]) {
+      char * copy = arena_.allocate(meshLength_[i]);
+      memcpy(copy, meshData_[i], meshLength_[i]);
+      meshData_[i] = copy;
+    }
+    if (indexedData_[i]) {
+      char * copy = arena_.allocate(indexedLength_[i]);
+      memcpy(copy, indexedData_[i], indexedLength_[i]);
+      indexedData_[i] = copy;
+    }
+  }
+  blob_.reset();
 }
 
 /*****************************************************************/
 
+// Shared by every constructor, the input is set by the delegating one.
+// `bounds` are the known selection bounds, NULL if they are to be scanned.
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t miplevels,
+                            const CTaskMesherOptions & options, CMesherScratch * scratch, const CSelectionBounds * bounds) :
+volume_(NULL), index_(NULL), status_(TASKMESHER_RESULT_OK), meshed_(false), knownVoxels_(bounds ? bounds->voxels : SIZE_MAX), scratch_(scratch),
+options_(options), dim_(dim), segments_(segments.begin(), segments.end()), lookup_(segments_), miplevels_(miplevels),
+bboxMin_(bounds ? bounds->min : dim), bboxMax_(bounds ? bounds->max : zi::vl::vec<size_t, 3>(0, 0, 0))
+{
+}
+
+// Meshes the input, `invalidResult` instead if it is invalid. Nothing
+// borrowed is referenced afterwards.
 template<typename T>
-inline void CTaskMesher<T>::idxToXYZ(size_t idx, size_t &x, size_t &y, size_t &z) const {
-  x = idx % dim_[0];
-  y = (idx / dim_[0]) % dim_[1];
-  z = idx / (dim_[0] * dim_[1]);
+void CTaskMesher<T>::build(bool validInput, TaskMesherResult invalidResult)
+{
+    if (validInput) {
+        generate();
+    } else {
+        init();
+        abort(invalidResult);
+    }
+    releaseVolume();
+    index_ = NULL;
+    scratch_ = NULL;
 }
 
 /*****************************************************************/
 
 template<typename T>
-void CTaskMesher<T>::selectSegmentsFillHoles() {
-  const size_t x_off = 1;
-  const size_t y_off = dim_[0];
-  const size_t z_off = dim_[0] * dim_[1];
+CTaskMesher<T>::CTaskMesher(std::vector<T> segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t miplevels,
+                            const CTaskMesherOptions & options) :
+CTaskMesher(dim, segments, miplevels, options, NULL, NULL)
+{
+    ownedVolume_ = std::move(segmentation);
+    volume_ = ownedVolume_.data();
+    build(true);
+}
 
-  // Visit all voxels that are *not* part of the task segmentation, starting
-  // from a corner and set them to 0
-  std::vector<bool> queued(dim_[0] * dim_[1] * dim_[2], false);
-  std::queue<size_t> outer;
-  outer.push(0);
+/*****************************************************************/
 
-  size_t x_pos, y_pos, z_pos, pos;
-  while (!outer.empty()) {
-    pos = outer.front();
-    outer.pop();
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t miplevels,
+                            const CTaskMesherOptions & options, CMesherScratch * scratch) :
+CTaskMesher(dim, segments, miplevels, options, scratch, NULL)
+{
+    volume_ = segmentation;
+    build(true);
+}
 
-    idxToXYZ(pos, x_pos, y_pos, z_pos);
+/*****************************************************************/
 
-    if (segments_.find(volume_[pos]) == segments_.end()) {
-      volume_[pos] = 0;
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t miplevels,
+                            const CSelectionBounds & bounds, const CTaskMesherOptions & options) :
+CTaskMesher(dim, segments, miplevels, options, NULL, &bounds)
+{
+    volume_ = segmentation;
+    build(true);
+}
 
-      if (x_pos < dim_[0] - 1 && !queued[pos + x_off]) {
-        outer.push(pos + x_off);
-        queued[pos + x_off] = true;
-      }
-      if (x_pos > 0 && !queued[pos - x_off]) {
-        outer.push(pos - x_off);
-        queued[pos - x_off] = true;
-      }
-      if (y_pos < dim_[1] - 1 && !queued[pos + y_off]) {
-        outer.push(pos + y_off);
-        queued[pos + y_off] = true;
-      }
-      if (y_pos > 0 && !queued[pos - y_off]) {
-        outer.push(pos - y_off);
-        queued[pos - y_off] = true;
-      }
-      if (z_pos < dim_[2] - 1 && !queued[pos + z_off]) {
-        outer.push(pos + z_off);
-        queued[pos + z_off] = true;
-      }
-      if (z_pos > 0 && !queued[pos - z_off]) {
-        outer.push(pos - z_off);
-        queued[pos - z_off] = true;
+/*****************************************************************/
+
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const T * segmentation, const CSegmentIndex<T> & index, const std::vector<T> & segments, uint8_t miplevels,
+                            const CTaskMesherOptions & options, CMesherScratch * scratch) :
+CTaskMesher(index.dim(), segments, miplevels, options, scratch, NULL)
+{
+    volume_ = segmentation;
+    index_ = &index;
+    build(index.valid());
+}
+
+/*****************************************************************/
+
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const CBlockReader<T> & reader, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t miplevels,
+                            const CTaskMesherOptions & options) :
+CTaskMesher(dim, segments, miplevels, options, NULL, NULL)
+{
+    reader_ = reader;
+    build(!options.fillHoles, TASKMESHER_RESULT_UNSUPPORTED);
+}
+
+/*****************************************************************/
+
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const CCompressedSegmentation & segmentation, const std::vector<T> & segments, uint8_t miplevels,
+                            const CTaskMesherOptions & options, CMesherScratch * scratch) :
+CTaskMesher(segmentation.dim(), segments, miplevels, options, scratch, NULL)
+{
+    compressed_ = segmentation;
+    build(compressed_.valid());
+}
+
+/*****************************************************************/
+
+// Task size stored in a blob, zero if the blob is invalid
+inline zi::vl::vec<size_t, 3> MeshBlobDim(const CMeshBlob & blob)
+{
+  if (!blob.valid()) {
+    return zi::vl::vec<size_t, 3>(0, 0, 0);
+  }
+  const CMeshBlobHeader & header = blob.header();
+  return zi::vl::vec<size_t, 3>(header.dim[0], header.dim[1], header.dim[2]);
+}
+
+template<typename T>
+CTaskMesher<T>::CTaskMesher(const std::shared_ptr<const CMeshBlob> & blob, uint64_t key) :
+CTaskMesher(MeshBlobDim(*blob), std::vector<T>(), 0, CTaskMesherOptions(), NULL, NULL)
+{
+    meshed_ = true;
+    bool valid = blob->valid();
+    if (valid) {
+        const CMeshBlobHeader & header = blob->header();
+        valid = header.key == key && header.labelBytes == sizeof(T) && header.lodCount > 0 &&
+                header.sectionCount >= 1 + 2 * uint64_t(header.lodCount);
+        if (valid) {
+            miplevels_ = header.lodCount - 1;
+        }
+    }
+    init();
+    if (!valid) {
+        abort(TASKMESHER_RESULT_READ_FAILED);
+        return;
+    }
+
+    // Section 0 holds the stats, then strip and indexed mesh of every LOD
+    blob_ = blob;
+    size_t length;
+    const char * stats = blob_->section(0, &length);
+    if (length == sizeof(stats_)) {
+        memcpy(&stats_, stats, length);
+    }
+    for (int lod = 0; lod < 1 + miplevels_; ++lod) {
+        meshData_[lod] = const_cast<char *>(blob_->section(1 + 2 * lod, &meshLength_[lod]));
+        indexedData_[lod] = const_cast<char *>(blob_->section(2 + 2 * lod, &indexedLength_[lod]));
+    }
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CTaskMesher<T>::init()
+{
+    for (int i = 0; i < 1 + miplevels_; ++i) {
+      meshData_[i] = NULL;
+      indexedData_[i] = NULL;
+    }
+    nextLod_ = 1 + miplevels_; // Everything is built unless LOD generation is deferred
+    pendingScale_[0] = pendingScale_[1] = pendingScale_[2] = 1.0f;
+    for (int i = 0; i < 3; ++i) {
+      vertexScale_[i] = 1.0;
+      vertexOffset_[i] = 0.0;
+    }
+
+    memset(&stats_, 0, sizeof(stats_));
+    trackedBytes_ = 0;
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CTaskMesher<T>::generate()
+{
+    init();
+    trackBytes(ownedVolume_.size() * sizeof(T));
+
+    if (options_.timeLimit > 0.0) {
+        deadline_ = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options_.timeLimit));
+    }
+
+    if (segments_.empty()) { // Shortcut for empty tasks
+        meshed_ = true;
+        return;
+    }
+
+    // Blocks are marched cropped and translated, see TranslateTriangles
+    static const bool layoutMatches = PackedVertexLayoutMatches();
+    if (!layoutMatches) {
+        abort(TASKMESHER_RESULT_UNSUPPORTED);
+        meshed_ = true;
+        return;
+    }
+
+    CStageTimer t;
+
+    {
+        zi::mesh::int_mesh im;
+        int64_t triangleBytes = 0;
+
+        if (reader_) {
+            // 3. + 4. Mask and march block by block
+            stats_.mcTriangles = marchChunked(im);
+            triangleBytes = stats_.mcTriangles * sizeof(typename MCTriangles<uint8_t>::value_type);
+            releaseVolume();
+            t.reset();
+        } else {
+            // 3. Mask and Merge Segments
+            std::vector<uint8_t> mask;
+            if (scratch_) mask.swap(scratch_->mask); // Capacity left by the previous job
+            zi::vl::vec<size_t, 3> origin, extent;
+            const bool preview = options_.previewDim[0] > 0 && options_.previewDim[1] > 0 && options_.previewDim[2] > 0;
+            const bool selected = !compressed_.empty() ? selectCompressed(mask, origin, extent, preview, options_.fillHoles)
+                                : preview ? downsampleSegments(mask, origin, extent, options_.fillHoles)
+                                          : selectSegments(mask, origin, extent, options_.fillHoles);
+            releaseVolume(); // Labels are not needed anymore
+            trackBytes(mask.size());
+
+            recordStage(TASKMESHER_STAGE_MASK, t.wall(), t.cpu());
+            if (options_.verbose) std::cout << "Masking segmentation data: " << t.wall() << " s\n";
+            t.reset();
+
+            if (!selected) { // Or cancelled
+                if (scratch_) mask.swap(scratch_->mask);
+                meshed_ = true;
+                return;
+            }
+
+            // 4. Run Marching Cubes on the bounding box of the selection only
+            double workerCpu = 0.0;
+            stats_.mcTriangles = marchBlock(mask, origin, extent, im, workerCpu);
+            triangleBytes = stats_.mcTriangles * sizeof(typename MCTriangles<uint8_t>::value_type);
+            trackBytes(triangleBytes);
+            trackBytes(-int64_t(mask.size()));
+            if (scratch_) mask.swap(scratch_->mask);
+            std::vector<uint8_t>().swap(occupied_);
+
+            recordStage(TASKMESHER_STAGE_MARCHING_CUBES, t.wall(), t.cpu() + workerCpu);
+            if (options_.verbose) std::cout << "Marching Cubes (" << extent[0] << "x" << extent[1] << "x" << extent[2] << "): " << t.wall() << " s\n";
+            t.reset();
+        }
+
+        if (stats_.mcTriangles > 0 && !aborted()) {
+            simplifier_.reset(new zi::mesh::simplifier<double>());
+            im.fill_simplifier<double>(*simplifier_, vertexOffset_[2], vertexOffset_[1], vertexOffset_[0],
+                                       vertexScale_[2], vertexScale_[1], vertexScale_[0]);
+            trackBytes(SimplifierBytes(stats_.mcTriangles));
+        }
+        trackBytes(-triangleBytes);
+    }
+
+    // 5. Mesh Cleanup and Simplification
+    if (simplifier_ && !aborted()) {
+        simplifier_->prepare();
+
+        recordStage(TASKMESHER_STAGE_PREPARE, t.wall(), t.cpu());
+        if (options_.verbose) std::cout << "Quadrics and Normal calculation." << t.wall() << " s\n";
+        t.reset();
+
+        switch (options_.lodMode) {
+        case TASKMESHER_LOD_LAZY:
+          nextLod_ = 0;
+          break;
+        case TASKMESHER_LOD_BACKGROUND:
+          nextLod_ = 0;
+          buildLod(std::min<int>(1, miplevels_), true); // Raw and first simplified mesh, within the time limit
+          if (!aborted()) {
+            background_ = std::thread([this]() {
+              for (int lod = 2; lod <= miplevels_; ++lod) {
+                buildLod(lod);
+              }
+            });
+          }
+          break;
+        default:
+          if (options_.independentLods) {
+            buildLodsIndependent(*simplifier_);
+          } else {
+            buildLodsPipelined(*simplifier_);
+          }
+          simplifier_.reset();
+          trackBytes(-SimplifierBytes(stats_.mcTriangles));
+          break;
+        }
+    }
+
+    // Nothing of a failed generation is kept. A running background thread
+    // notices a later cancellation by itself.
+    if (GetStatus() != TASKMESHER_RESULT_OK && !background_.joinable()) {
+        discardMeshes();
+    }
+}
+
+/*****************************************************************/
+
+// Advances the cached simplifier until `lod` has been built. Levels passed on
+// the way are serialized and cached as well, since the simplifier cannot go
+// back to them. `checkDeadline` is set for the levels the constructor builds,
+// those count against the time limit like the rest of generation.
+template<typename T>
+void CTaskMesher<T>::buildLod(int lod, bool checkDeadline)
+{
+  std::lock_guard<std::mutex> building(builderMutex_);
+
+  while (nextLod_ <= lod) {
+    if (aborted(checkDeadline)) { // Nothing more is built, GetMesh returns empty meshes
+      std::lock_guard<std::mutex> state(stateMutex_);
+      nextLod_ = 1 + miplevels_;
+      break;
+    }
+
+    CStageTimer t;
+    double simplifyWall = 0.0, simplifyCpu = 0.0;
+    if (nextLod_ > 0) {
+      double bytesPerFace;
+      {
+        std::lock_guard<std::mutex> state(stateMutex_);
+        bytesPerFace = BytesPerFace(stats_.lodBytes[nextLod_ - 1], stats_.lodFaces[nextLod_ - 1], options_.outputFormats);
       }
-    } else {
-      volume_[pos] = 1; // That's the outer hull of our segmentation!
+      size_t targetFaces;
+      double maxError;
+      lodTarget(nextLod_, simplifier_->face_count(), bytesPerFace, targetFaces, maxError);
+      simplifier_->optimize(targetFaces, maxError);
+      simplifyWall = t.wall();
+      simplifyCpu = t.cpu();
+      t.reset();
     }
+
+    CMeshBuffers buffers = serializeLod(*simplifier_, nextLod_, checkDeadline);
+
+    std::lock_guard<std::mutex> state(stateMutex_);
+    recordStage(TASKMESHER_STAGE_SIMPLIFY, simplifyWall, simplifyCpu);
+    recordStage(TASKMESHER_STAGE_SERIALIZE, t.wall(), 0.0); // CPU time is counted by storeMesh
+    storeMesh(nextLod_, buffers);
+    ++nextLod_;
   }
 
-  // Everything not queued (visited) is also part of our segmentation and will
-  // be set to 1
-  for (size_t i = dim_[0] * dim_[1]; i < (dim_[2] - 1) * dim_[0] * dim_[1]; ++i) {
-    if (!queued[i])
-      volume_[i] = 1;
+  if (nextLod_ > miplevels_ && simplifier_) {
+    simplifier_.reset();
+
+    std::lock_guard<std::mutex> state(stateMutex_);
+    trackBytes(-SimplifierBytes(stats_.mcTriangles));
   }
 }
 
 /*****************************************************************/
 
 template<typename T>
-void CTaskMesher<T>::selectSegmentsLeaveHoles() {
-  for (int pos = 0; pos < dim_[0] * dim_[1] * dim_[2]; ++pos) {
-    volume_[pos] = segments_.find(volume_[pos]) != segments_.end();
-  }
+bool CTaskMesher<T>::isBuilt(int lod) const
+{
+  std::lock_guard<std::mutex> state(stateMutex_);
+  return lod < nextLod_;
 }
 
 /*****************************************************************/
 
+// Runs marching cubes over `block` (located at `origin` in the task) and adds
+// the triangles of the selection to `im`, in task coordinates. With more than
+// one thread the block is split into z-slabs sharing their boundary voxel
+// plane. Slabs are merged in z order, so int_mesh sees exactly the triangle
+// sequence of a serial run and welds the seam vertices. Slabs are marched in
+// parts of TASKMESHER_CHECK_PLANES cube layers the same way, checking for
+// cancellation in between. With occupied_ set, parts are cropped to the
+// occupied index blocks (skipped if there are none), cubes outside of them
+// give no triangles and the order of the others is kept.
 template<typename T>
-void CTaskMesher<T>::selectSegments(bool fillHoles) {
-  if (segments_.empty()) {
-    memset(&volume_[0], 0, sizeof(T) * dim_[0] * dim_[1] * dim_[2]);
-    return;
-  }
+size_t CTaskMesher<T>::marchBlock(const std::vector<uint8_t> & block, const zi::vl::vec<size_t, 3> & origin,
+                                  const zi::vl::vec<size_t, 3> & extent, zi::mesh::int_mesh & im, double & workerCpu)
+{
+  const size_t MIN_SLAB_DEPTH = 16;
+  const size_t planeSize = extent[0] * extent[1];
+  const size_t cubeLayers = extent[2] - 1;
+  const size_t slabCount = std::max<size_t>(1, std::min<size_t>(options_.threadCount, cubeLayers / MIN_SLAB_DEPTH));
+
+  std::vector<std::vector<MCTriangles<uint8_t>>> triangles(slabCount); // parts of every slab, in z order
+  std::vector<double> slabCpu(slabCount, 0.0);
+  auto marchSlab = [&](size_t slab) {
+    const double cpu = ThreadCpuTime();
+    const size_t zBegin = cubeLayers * slab / slabCount;
+    const size_t zEnd = cubeLayers * (slab + 1) / slabCount;
+
+    std::vector<uint8_t> cropped;
+    for (size_t z0 = zBegin; z0 < zEnd && !aborted(); z0 += TASKMESHER_CHECK_PLANES) {
+      const size_t z1 = std::min(z0 + TASKMESHER_CHECK_PLANES, zEnd);
+      size_t xBegin = 0, xEnd = extent[0], yBegin = 0, yEnd = extent[1];
+      if (!occupied_.empty() && !occupiedRect(origin, extent, z0, z1, xBegin, xEnd, yBegin, yEnd)) {
+        continue;
+      }
 
-  // Set all boundary voxel to 0
-  memset(&volume_[0], 0, sizeof(T) * dim_[0] * dim_[1]);
-  memset(&volume_[(dim_[2] - 1) * dim_[0] * dim_[1]], 0, sizeof(T) * dim_[0] * dim_[1]);
-  for (size_t z = 1; z < dim_[2] - 1; ++z) {
-    memset(&volume_[z * dim_[0] * dim_[1]], 0, sizeof(T) * dim_[0]);
-    memset(&volume_[z * dim_[0] * dim_[1] + (dim_[1] - 1) * dim_[0]], 0, sizeof(T) * dim_[0]);
-    for (size_t y = 1; y < dim_[1] - 1; ++y) {
-      memset(&volume_[z * dim_[0] * dim_[1] + y * dim_[0] - 1], 0, 2 * sizeof(T));
+      const uint8_t * voxels = &block[z0 * planeSize];
+      if (xEnd - xBegin < extent[0] || yEnd - yBegin < extent[1]) {
+        cropped.resize((xEnd - xBegin) * (yEnd - yBegin) * (z1 - z0 + 1));
+        for (size_t z = 0; z <= z1 - z0; ++z) {
+          for (size_t y = yBegin; y < yEnd; ++y) {
+            memcpy(&cropped[(xEnd - xBegin) * (y - yBegin + (yEnd - yBegin) * z)], voxels + xBegin + extent[0] * (y + extent[1] * z), xEnd - xBegin);
+          }
+        }
+        voxels = cropped.data();
+      }
+
+      zi::mesh::marching_cubes<uint8_t> mc;
+      mc.marche(voxels, z1 - z0 + 1, yEnd - yBegin, xEnd - xBegin);
+      if (mc.count(1) > 0) {
+        triangles[slab].push_back(mc.get_triangles(1));
+        TranslateTriangles(triangles[slab].back(), origin[2] + z0, origin[1] + yBegin, origin[0] + xBegin);
+      }
     }
+    slabCpu[slab] = ThreadCpuTime() - cpu;
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t slab = 1; slab < slabCount; ++slab) {
+    workers.push_back(std::thread(marchSlab, slab));
+  }
+  marchSlab(0);
+  for (auto worker = workers.begin(); worker != workers.end(); ++worker) {
+    worker->join();
   }
 
-  if (fillHoles) {
-    selectSegmentsFillHoles();
-  } else {
-    selectSegmentsLeaveHoles();
+  // Slab 0 ran on the calling thread
+  workerCpu = 0.0;
+  for (size_t slab = 1; slab < slabCount; ++slab) {
+    workerCpu += slabCpu[slab];
   }
+
+  size_t triangleCount = 0;
+  for (size_t slab = 0; slab < slabCount; ++slab) {
+    for (auto part = triangles[slab].begin(); part != triangles[slab].end() && !aborted(); ++part) {
+      im.add(*part);
+      triangleCount += part->size();
+    }
+  }
+
+  return triangleCount;
 }
 
 /*****************************************************************/
 
+// Chunked input: reads the task in z-blocks and masks and marches each block
+// on its own. A block owns the cube layers between its planes and reads one
+// plane of overlap, so every cube is marched exactly once. Blocks are added
+// to `im` in z order and int_mesh welds the shared boundary planes, which
+// gives the same mesh as a single block over the whole task.
 template<typename T>
-bool CTaskMesher<T>::GetMesh(uint8_t lod, const char ** data, size_t * length) const
+size_t CTaskMesher<T>::marchChunked(zi::mesh::int_mesh & im)
 {
-  if (lod < 1 + miplevels_) {
-    if (meshData_[lod]) {
-      *length = meshLength_[lod];
-      *data   = meshData_[lod];
-    } else {
-      *length = 0;
-      *data = empty_mesh;
+  const size_t planeSize = dim_[0] * dim_[1];
+  const size_t blockPlanes = std::max<size_t>(2, options_.blockBytes / (planeSize * sizeof(T))) - 1;
+  const size_t triangleSize = sizeof(typename MCTriangles<uint8_t>::value_type);
+
+  std::vector<T> scratch(planeSize * (std::min(blockPlanes, dim_[2]) + 1));
+  trackBytes(scratch.size() * sizeof(T));
+
+  std::vector<uint8_t> mask; // Capacity reused from block to block
+
+  size_t triangleCount = 0;
+  for (size_t z0 = 0; z0 + 1 < dim_[2]; z0 += blockPlanes) {
+    CStageTimer t;
+    const size_t z1 = std::min(z0 + blockPlanes, dim_[2] - 1); // cube layers [z0, z1)
+    const T * labels = aborted() ? NULL : reader_(z0, z1 - z0 + 1, scratch.data());
+    if (!labels) { // Drop what was marched so far, generate() then skips the simplifier
+      abort(TASKMESHER_RESULT_READ_FAILED); // Unless it was cancelled
+      trackBytes(-int64_t(triangleCount * triangleSize));
+      triangleCount = 0;
+      break;
     }
-    return true;
-  }
-  return false;
-}
\ No newline at end of file
+
+    // Selection of the owned planes, plus the overlap plane for the bounding box
+    zi::vl::vec<size_t, 3> bboxMin(dim_), bboxMax(0, 0, 0);
+    stats_.voxelsSelected += lookup_.bounds(labels, dim_, bboxMin, bboxMax, z0, z1 - z0);
+    lookup_.bounds(labels + (z1 - z0) * planeSize, dim_, bboxMin, bboxMax, z1, 1);
+    stats_.voxelsScanned += (z1 - z0 + 1) * planeSize;
+
+    if (bboxMin[2] > bboxMax[2]) { // Nothing selected
+      recordStage(TASKMESHER_STAGE_MASK, t.wall(), t.cpu());
+      continue;
+    }
+
+    zi::vl::vec<size_t, 3> origin, extent;
+    for (int i = 0; i < 2; ++i) {
+      origin[i] = bboxMin[i] > 0 ? bboxMin[i] - 1 : 0;
+      extent[i] = std::min(bboxMax[i] + 2, dim_[i]) - origin[i];
+    }
+    origin[2] = std::max(z0, bboxMin[2] - 1);
+    extent[2] = std::min(z1, bboxMax[2] + 1) - origin[2] + 1;
+    for (int i = 0; i < 3; ++i) {
+      bboxMin_[i] = std::min(bboxMin_[i], bboxMin[i]);
+      bboxMax_[i] = std::max(bboxMax_[i], bboxMax[i]);
+    }
+
+    mask.assign(extent[0] * extent[1] * extent[2], 0);
+    lookup_.extract(labels, dim_, origin, extent, &mask[0], z0);
+    stats_.voxelsScanned += mask.size();
+    trackBytes(mask.size());
+
+    recordStage(TASKMESHER_STAGE_MASK, t.wall(), t.cpu());
+    t.reset();
+
+    double workerCpu = 0.0;
+    const size_t blockTriangles = marchBlock(mask, origin, extent, im, workerCpu);
+    triangleCount += blockTriangles;
+    trackBytes(blockTriangles * triangleSize);
+    trackBytes(-int64_t(mask.size()));
+
+    recordStage(TASKMESHER_STAGE_MARCHING_CUBES, t.wall(), t.cpu() + workerCpu);
+    if (options_.verbose) std::cout << "Block z " << z0 << "-" << z1 << ": " << blockTriangles << " triangles\n";
+  }
+
+  trackBytes(-int64_t(scratch.size() * sizeof(T)));
+  return triangleCount;
+}
+
+/*****************************************************************/
+
+// Face target and error bound that simplify to `lod` (1..miplevels_) under
+// options_.lodPolicy. The simplifier stops at whichever it reaches first, so
+// error targets give as many faces as the shape needs and budgets stop as
+// soon as they are met. `faceCount` is where the fixed ratios start from,
+// `bytesPerFace` converts byte budgets into faces.
+template<typename T>
+void CTaskMesher<T>::lodTarget(int lod, size_t faceCount, double bytesPerFace, size_t & targetFaces, double & maxError) const
+{
+  const size_t level = lod - 1;
+  if (options_.lodPolicy == TASKMESHER_LOD_POLICY_RATIO || level >= options_.lodTargets.size()) {
+    LodSchedule(level, faceCount, targetFaces, maxError);
+    return;
+  }
+
+  const double target = std::max(0.0, options_.lodTargets[level]);
+  targetFaces = 0;
+  maxError = std::numeric_limits<double>::max();
+  switch (options_.lodPolicy) {
+    case TASKMESHER_LOD_POLICY_ERROR:
+      // Quadric errors are squared distances in output units, 2 per voxel
+      maxError = std::max(1e-12, 4.0 * target * target);
+      break;
+    case TASKMESHER_LOD_POLICY_TRIANGLES:
+      targetFaces = static_cast<size_t>(target);
+      break;
+    case TASKMESHER_LOD_POLICY_BYTES:
+      targetFaces = static_cast<size_t>(target / bytesPerFace);
+      break;
+  }
+}
+
+// 0 unless `lod` has a byte budget
+template<typename T>
+double CTaskMesher<T>::lodByteBudget(int lod) const
+{
+  if (options_.lodPolicy != TASKMESHER_LOD_POLICY_BYTES || lod < 1 || size_t(lod - 1) >= options_.lodTargets.size()) {
+    return 0.0;
+  }
+  return std::max(1.0, options_.lodTargets[lod - 1]);
+}
+
+// Serializes `s` as `lod`. A level over its byte budget is simplified further
+// by the measured overshoot and serialized again, until it fits, the
+// simplifier cannot remove more faces or TASKMESHER_BUDGET_PASSES are used
+// up. Attempts go to a scratch arena, only the last one is copied to arena_.
+// Their CPU time (and that of the extra simplification) is counted as
+// serialization.
+template<typename T>
+CMeshBuffers CTaskMesher<T>::serializeLod(zi::mesh::simplifier<double> & s, int lod, bool checkDeadline)
+{
+  const double budget = lodByteBudget(lod);
+  if (budget <= 0.0) {
+    return SerializeMesh(s, options_.outputFormats, &options_.transform, arena_);
+  }
+
+  CMeshArena attempts;
+  CMeshBuffers buffers = SerializeMesh(s, options_.outputFormats, &options_.transform, attempts);
+
+  for (int pass = 1; pass < TASKMESHER_BUDGET_PASSES && !aborted(checkDeadline); ++pass) {
+    const size_t bytes = buffers.stripBytes + buffers.indexedBytes;
+    const size_t faces = s.face_count();
+    if (bytes <= budget || faces == 0) {
+      break;
+    }
+
+    const double cpu = ThreadCpuTime();
+    // Aim a little below, bytes per face vary between levels
+    s.optimize(std::min(faces - 1, static_cast<size_t>(0.95 * faces * budget / bytes)), std::numeric_limits<double>::max());
+    const double spent = buffers.cpuTime + ThreadCpuTime() - cpu;
+    if (s.face_count() == faces) {
+      buffers.cpuTime = spent;
+      break;
+    }
+    attempts.release();
+    buffers = SerializeMesh(s, options_.outputFormats, &options_.transform, attempts);
+    buffers.cpuTime += spent;
+  }
+
+  const double cpu = ThreadCpuTime();
+  if (buffers.strip) {
+    buffers.strip = static_cast<char *>(memcpy(arena_.allocate(buffers.stripBytes), buffers.strip, buffers.stripBytes));
+  }
+  if (buffers.indexed) {
+    buffers.indexed = static_cast<char *>(memcpy(arena_.allocate(buffers.indexedBytes), buffers.indexed, buffers.indexedBytes));
+  }
+  buffers.cpuTime += ThreadCpuTime() - cpu;
+  return buffers;
+}
+
+/*****************************************************************/
+
+// Simplifies level after level on `s`. Each level is snapshotted and
+// stripified on its own thread while the next level is being simplified.
+// Levels with a byte budget are serialized right away instead, the next one
+// continues from the fitted mesh.
+template<typename T>
+void CTaskMesher<T>::buildLodsPipelined(zi::mesh::simplifier<double> & s)
+{
+  typedef zi::mesh::simplifier<double> Simplifier;
+  std::vector<std::future<CMeshBuffers>> strips;
+  std::vector<int64_t> snapshotBytes;
+  const uint8_t formats = options_.outputFormats;
+  const CVertexTransform * transform = &options_.transform;
+  CMeshArena * arena = &arena_;
+  double bytesPerFace = EstimatedBytesPerFace(formats);
+
+  CStageTimer t;
+
+  for (int lod = 0; lod <= miplevels_; ++lod) {
+    if (lod > 0) {
+      if (aborted()) { // Levels in flight are still waited for below
+        break;
+      }
+
+      size_t targetFaces;
+      double maxError;
+      lodTarget(lod, s.face_count(), bytesPerFace, targetFaces, maxError);
+      s.optimize(targetFaces, maxError);
+
+      recordStage(TASKMESHER_STAGE_SIMPLIFY, t.wall(), t.cpu());
+      if (options_.verbose) std::cout << "Simplification " << std::to_string(lod) << ": " << t.wall() << " s\n";
+      t.reset();
+    }
+
+    const bool budget = lodByteBudget(lod) > 0.0;
+    if (budget) {
+      CMeshBuffers buffers = serializeLod(s, lod);
+      bytesPerFace = BytesPerFace(buffers.stripBytes + buffers.indexedBytes, buffers.faces, formats);
+      std::promise<CMeshBuffers> fitted;
+      fitted.set_value(buffers);
+      strips.push_back(fitted.get_future());
+      snapshotBytes.push_back(0);
+    } else if (lod == miplevels_) { // Nothing left to simplify, no snapshot needed
+      strips.push_back(std::async(std::launch::deferred, [&s, formats, transform, arena]() { return SerializeMesh(s, formats, transform, *arena); }));
+      snapshotBytes.push_back(0);
+    } else {
+      std::shared_ptr<Simplifier> snapshot = std::make_shared<Simplifier>(s);
+      strips.push_back(std::async(std::launch::async, [snapshot, formats, transform, arena]() { return SerializeMesh(*snapshot, formats, transform, *arena); }));
+      snapshotBytes.push_back(SimplifierBytes(s.face_count()));
+      trackBytes(snapshotBytes.back());
+    }
+
+    recordStage(TASKMESHER_STAGE_SERIALIZE, t.wall(), budget ? 0.0 : t.cpu()); // Taking the snapshot, or serializing (counted by storeMesh)
+    t.reset();
+  }
+
+  CStageTimer wait;
+  for (size_t lod = 0; lod < strips.size(); ++lod) {
+    storeMesh(lod, strips[lod].get());
+    trackBytes(-snapshotBytes[lod]);
+  }
+  recordStage(TASKMESHER_STAGE_SERIALIZE, wait.wall(), 0.0); // CPU time is counted by storeMesh
+
+  if (options_.verbose) std::cout << "Stripification: " << wait.wall() << " s\n";
+}
+
+/*****************************************************************/
+
+// Simplifies every level concurrently from its own copy of the prepared base
+// mesh. Face targets are derived from the base face count, so the coarser
+// levels can differ slightly from the sequential schedule.
+template<typename T>
+void CTaskMesher<T>::buildLodsIndependent(zi::mesh::simplifier<double> & base)
+{
+  typedef zi::mesh::simplifier<double> Simplifier;
+  std::vector<std::future<CMeshBuffers>> strips;
+  std::vector<double> simplifyCpu(miplevels_, 0.0);
+  const uint8_t formats = options_.outputFormats;
+  const CVertexTransform * transform = &options_.transform;
+  const int64_t levelBytes = SimplifierBytes(base.face_count());
+
+  CStageTimer t;
+
+  // Fixed ratios continue from the previous level's face target while no
+  // earlier level had a policy target. After one, a level simplifies towards
+  // its own target concurrently, then waits for the previous level's actual
+  // face count: untargeted levels continue from it like the pipelined path,
+  // targeted ones are clamped to it, so no LOD is larger than the one before.
+  size_t scheduleFaces = base.face_count();
+  const double bytesPerFace = EstimatedBytesPerFace(formats);
+  bool chained = true;
+  std::promise<size_t> baseFaces;
+  baseFaces.set_value(base.face_count());
+  std::shared_future<size_t> previousFaces = baseFaces.get_future().share();
+  for (int lod = 1; lod <= miplevels_; ++lod) {
+    const bool targeted = options_.lodPolicy != TASKMESHER_LOD_POLICY_RATIO && size_t(lod - 1) < options_.lodTargets.size();
+    chained = chained && !targeted;
+
+    size_t targetFaces;
+    double maxError;
+    lodTarget(lod, scheduleFaces, bytesPerFace, targetFaces, maxError);
+    scheduleFaces = targetFaces;
+
+    std::shared_ptr<Simplifier> level = std::make_shared<Simplifier>(base);
+    std::shared_ptr<std::promise<size_t>> faces = std::make_shared<std::promise<size_t>>();
+    std::shared_future<size_t> previous = previousFaces;
+    previousFaces = faces->get_future().share();
+    double * cpu = &simplifyCpu[lod - 1];
+    strips.push_back(std::async(std::launch::async, [this, level, lod, targeted, chained, targetFaces, maxError, bytesPerFace, previous, faces, cpu]() {
+      if (aborted()) {
+        faces->set_value(0);
+        return CMeshBuffers();
+      }
+      double start = ThreadCpuTime();
+      if (chained || targeted) {
+        level->optimize(targetFaces, maxError);
+      }
+      double spent = ThreadCpuTime() - start;
+
+      if (!chained) {
+        const size_t limit = previous.get();
+        start = ThreadCpuTime();
+        if (!targeted) {
+          size_t followFaces;
+          double followError;
+          lodTarget(lod, limit, bytesPerFace, followFaces, followError);
+          level->optimize(followFaces, followError);
+        }
+        if (level->face_count() > limit) {
+          level->optimize(limit, std::numeric_limits<double>::max());
+        }
+        spent += ThreadCpuTime() - start;
+      }
+      *cpu = spent;
+
+      CMeshBuffers buffers = serializeLod(*level, lod);
+      faces->set_value(buffers.faces);
+      return buffers;
+    }));
+    trackBytes(levelBytes);
+  }
+
+  CStageTimer serialize;
+  storeMesh(0, SerializeMesh(base, formats, transform, arena_));
+  const double serializeWall = serialize.wall();
+  const double serializeCpu = serialize.cpu();
+  recordStage(TASKMESHER_STAGE_SERIALIZE, serializeWall, 0.0); // CPU time is counted by storeMesh
+
+  for (int lod = 1; lod <= miplevels_; ++lod) {
+    storeMesh(lod, strips[lod - 1].get());
+    recordStage(TASKMESHER_STAGE_SIMPLIFY, 0.0, simplifyCpu[lod - 1]);
+    trackBytes(-levelBytes);
+  }
+
+  // The levels overlap, their wall time is all counted as simplification
+  recordStage(TASKMESHER_STAGE_SIMPLIFY, t.wall() - serializeWall, t.cpu() - serializeCpu);
+
+  if (options_.verbose) std::cout << "Independent simplification of " << std::to_string(miplevels_) << " levels: " << t.wall() << " s\n";
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CTaskMesher<T>::storeMesh(int lod, const CMeshBuffers & buffers)
+{
+  stats_.cpuTime[TASKMESHER_STAGE_SERIALIZE] += buffers.cpuTime;
+  stats_.lodFaces[lod] = buffers.faces;
+  stats_.lodVertices[lod] = buffers.vertices;
+  stats_.lodBytes[lod] = buffers.stripBytes + buffers.indexedBytes;
+  stats_.lodAcmr[lod] = buffers.acmr;
+  stats_.lodStripVerticesPerTriangle[lod] = buffers.stripVerticesPerTriangle;
+  stats_.lodCount = std::max<uint64_t>(stats_.lodCount, lod + 1);
+  trackBytes(stats_.lodBytes[lod]);
+
+  // Already in arena_, only referenced
+  meshLength_[lod] = buffers.stripBytes;
+  meshData_[lod] = buffers.strip;
+  indexedLength_[lod] = buffers.indexedBytes;
+  indexedData_[lod] = buffers.indexed;
+
+  if (pendingScale_[0] != 1.0f || pendingScale_[1] != 1.0f || pendingScale_[2] != 1.0f) {
+    scaleLod(lod, pendingScale_);
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+CTaskMesher<T>::~CTaskMesher()
+{
+  if (background_.joinable()) {
+    background_.join();
+  }
+  // The buffers go with arena_ (or belong to blob_)
+}
+
+/*****************************************************************/
+
+template<typename T>
+void CTaskMesher<T>::releaseVolume()
+{
+  if (!ownedVolume_.empty()) {
+    trackBytes(-int64_t(ownedVolume_.size() * sizeof(T)));
+  }
+  std::vector<T>().swap(ownedVolume_);
+  volume_ = NULL;
+  reader_ = nullptr;
+  compressed_ = CCompressedSegmentation();
+}
+
+/*****************************************************************/
+
+// Bounding box of the selection grown by one voxel on each side (clamped to
+// the volume of size `dim`). `origin` receives the coordinates of the
+// block's first voxel, `extent` its dimensions.
+template<typename T>
+void CTaskMesher<T>::cropBounds(const zi::vl::vec<size_t, 3> & dim, zi::vl::vec<size_t, 3> & origin, zi::vl::vec<size_t, 3> & extent) const {
+  for (int i = 0; i < 3; ++i) {
+    origin[i] = bboxMin_[i] > 0 ? bboxMin_[i] - 1 : 0;
+    extent[i] = std::min(bboxMax_[i] + 2, dim[i]) - origin[i];
+  }
+}
+
+/*****************************************************************/
+
+// Visits all background voxels connected to the border of the block and
+// marks them as outside. Everything else (the selection and any cavity
+// enclosed by it) becomes part of the mask.
+//
+// Scanline flood fill: a row is filled span by span, each filled span is
+// pushed once to be continued in the four neighbouring rows (y +- 1, z +- 1).
+// Voxels are touched a constant number of times and no coordinates have to
+// be recovered from linear indices. Runs on the calling thread only.
+template<typename T>
+void CTaskMesher<T>::fillHoles(std::vector<uint8_t> & mask, const zi::vl::vec<size_t, 3> & extent) const {
+  const uint8_t OUTSIDE = 2;
+  const size_t width = extent[0];
+
+  struct CSpan {
+    size_t y, z, xBegin, xEnd; // filled [xBegin, xEnd) in row (y, z)
+  };
+  std::vector<CSpan> stack;
+
+  auto row = [&](size_t y, size_t z) { return &mask[width * (y + extent[1] * z)]; };
+
+  // Fills the background run through x, returns its end
+  auto fillRun = [&](size_t y, size_t z, size_t x) {
+    uint8_t * r = row(y, z);
+    size_t begin = x, end = x;
+    while (begin > 0 && r[begin - 1] == 0) --begin;
+    while (end < width && r[end] == 0) ++end;
+    memset(r + begin, OUTSIDE, end - begin);
+    stack.push_back(CSpan{ y, z, begin, end });
+    return end;
+  };
+
+  // Fills every background run in row (y, z) that overlaps [xBegin, xEnd)
+  auto fillRow = [&](size_t y, size_t z, size_t xBegin, size_t xEnd) {
+    const uint8_t * r = row(y, z);
+    for (size_t x = xBegin; x < xEnd; ++x) {
+      if (r[x] == 0) x = fillRun(y, z, x);
+    }
+  };
+
+  // Seeds: all rows on the y/z faces, both ends of all other rows
+  for (size_t z = 0; z < extent[2]; ++z) {
+    for (size_t y = 0; y < extent[1]; ++y) {
+      if (y == 0 || z == 0 || y == extent[1] - 1 || z == extent[2] - 1) {
+        fillRow(y, z, 0, width);
+      } else {
+        fillRow(y, z, 0, 1);
+        fillRow(y, z, width - 1, width);
+      }
+
+      while (!stack.empty()) {
+        const CSpan span = stack.back();
+        stack.pop_back();
+
+        if (span.y > 0)              fillRow(span.y - 1, span.z, span.xBegin, span.xEnd);
+        if (span.y + 1 < extent[1])  fillRow(span.y + 1, span.z, span.xBegin, span.xEnd);
+        if (span.z > 0)              fillRow(span.y, span.z - 1, span.xBegin, span.xEnd);
+        if (span.z + 1 < extent[2])  fillRow(span.y, span.z + 1, span.xBegin, span.xEnd);
+      }
+    }
+  }
+
+  uint8_t * voxel = mask.data();
+  for (size_t i = 0; i < mask.size(); ++i) {
+    voxel[i] = voxel[i] != OUTSIDE;
+  }
+}
+
+/*****************************************************************/
+
+// Masks the selected segments into a compact one-byte-per-voxel block that
+// covers only the bounding box of the selection. The label volume is only
+// read. Returns false if no voxel is selected.
+template<typename T>
+bool CTaskMesher<T>::selectSegments(std::vector<uint8_t> & mask, zi::vl::vec<size_t, 3> & origin,
+                                    zi::vl::vec<size_t, 3> & extent, bool fillHoles) {
+  const size_t planeSize = dim_[0] * dim_[1];
+  if (knownVoxels_ != SIZE_MAX) {
+    stats_.voxelsSelected = knownVoxels_;
+  } else if (index_) {
+    const CSelectionBounds bounds = index_->bounds(segments_);
+    bboxMin_ = bounds.min;
+    bboxMax_ = bounds.max;
+    stats_.voxelsSelected = bounds.voxels;
+  } else {
+    stats_.voxelsSelected = 0;
+    for (size_t z = 0; z < dim_[2]; z += TASKMESHER_CHECK_PLANES) {
+      if (aborted()) {
+        return false;
+      }
+      stats_.voxelsSelected += lookup_.bounds(volume_ + z * planeSize, dim_, bboxMin_, bboxMax_, z, TASKMESHER_CHECK_PLANES);
+    }
+    if (dim_[0] > 2 && dim_[1] > 2 && dim_[2] > 2) {
+      stats_.voxelsScanned = (dim_[0] - 2) * (dim_[1] - 2) * (dim_[2] - 2);
+    }
+  }
+  if (stats_.voxelsSelected == 0) {
+    return false;
+  }
+
+  cropBounds(dim_, origin, extent);
+  mask.resize(extent[0] * extent[1] * extent[2]);
+  if (index_) {
+    if (!extractOccupied(mask, origin, extent)) {
+      return false;
+    }
+  } else {
+    stats_.voxelsScanned += mask.size();
+    for (size_t z = 0; z < extent[2]; z += TASKMESHER_CHECK_PLANES) {
+      if (aborted()) {
+        return false;
+      }
+      const zi::vl::vec<size_t, 3> partOrigin(origin[0], origin[1], origin[2] + z);
+      const zi::vl::vec<size_t, 3> partExtent(extent[0], extent[1], std::min(TASKMESHER_CHECK_PLANES, extent[2] - z));
+      lookup_.extract(volume_, dim_, partOrigin, partExtent, &mask[z * extent[0] * extent[1]]);
+    }
+  }
+
+  if (fillHoles) {
+    this->fillHoles(mask, extent);
+  }
+
+  return true;
+}
+
+/*****************************************************************/
+
+// Index input: masks the runs of occupied index blocks (along x) within the
+// box at `origin`, the rest of the box is 0 without reading its labels. The
+// occupied blocks are kept in occupied_ for marchBlock.
+template<typename T>
+bool CTaskMesher<T>::extractOccupied(std::vector<uint8_t> & mask, const zi::vl::vec<size_t, 3> & origin, const zi::vl::vec<size_t, 3> & extent) {
+  const size_t blockSize = index_->blockSize();
+  const zi::vl::vec<size_t, 3> & grid = index_->grid();
+  index_->occupancy(segments_, occupied_);
+  std::fill(mask.begin(), mask.end(), 0);
+
+  for (size_t bz = origin[2] / blockSize; bz <= (origin[2] + extent[2] - 1) / blockSize; ++bz) {
+    if (aborted()) {
+      return false;
+    }
+    const size_t zBegin = std::max(bz * blockSize, origin[2]), zEnd = std::min((bz + 1) * blockSize, origin[2] + extent[2]);
+    for (size_t by = origin[1] / blockSize; by <= (origin[1] + extent[1] - 1) / blockSize; ++by) {
+      const size_t yBegin = std::max(by * blockSize, origin[1]), yEnd = std::min((by + 1) * blockSize, origin[1] + extent[1]);
+      const uint8_t * occupied = &occupied_[grid[0] * (by + grid[1] * bz)];
+
+      for (size_t bx = origin[0] / blockSize; bx <= (origin[0] + extent[0] - 1) / blockSize; ) {
+        if (!occupied[bx]) {
+          ++bx;
+          continue;
+        }
+        const size_t xBegin = std::max(bx * blockSize, origin[0]);
+        while (bx <= (origin[0] + extent[0] - 1) / blockSize && occupied[bx]) ++bx;
+        const size_t xEnd = std::min(bx * blockSize, origin[0] + extent[0]);
+
+        const zi::vl::vec<size_t, 3> rowExtent(xEnd - xBegin, 1, 1);
+        for (size_t z = zBegin; z < zEnd; ++z) {
+          for (size_t y = yBegin; y < yEnd; ++y) {
+            lookup_.extract(volume_, dim_, zi::vl::vec<size_t, 3>(xBegin, y, z), rowExtent,
+                            &mask[xBegin - origin[0] + extent[0] * (y - origin[1] + extent[1] * (z - origin[2]))]);
+          }
+        }
+        stats_.voxelsScanned += (xEnd - xBegin) * (yEnd - yBegin) * (zEnd - zBegin);
+      }
+    }
+  }
+  return true;
+}
+
+// Part of a mask box (`origin`, `extent`) that marchBlock has to march for
+// the planes [zBegin, zEnd] of the box: the occupied blocks of these planes
+// grown by the one voxel their cubes reach beyond them, as [xBegin, xEnd) x
+// [yBegin, yEnd) relative to the box. False if no block is occupied.
+template<typename T>
+bool CTaskMesher<T>::occupiedRect(const zi::vl::vec<size_t, 3> & origin, const zi::vl::vec<size_t, 3> & extent, size_t zBegin, size_t zEnd,
+                                  size_t & xBegin, size_t & xEnd, size_t & yBegin, size_t & yEnd) const {
+  const size_t blockSize = index_->blockSize();
+  const zi::vl::vec<size_t, 3> & grid = index_->grid();
+
+  zi::vl::vec<size_t, 3> first(grid[0], grid[1], 0), last(0, 0, 0);
+  for (size_t bz = (origin[2] + zBegin) / blockSize; bz <= (origin[2] + zEnd) / blockSize; ++bz) {
+    for (size_t by = origin[1] / blockSize; by <= (origin[1] + extent[1] - 1) / blockSize; ++by) {
+      const uint8_t * occupied = &occupied_[grid[0] * (by + grid[1] * bz)];
+      for (size_t bx = origin[0] / blockSize; bx <= (origin[0] + extent[0] - 1) / blockSize; ++bx) {
+        if (occupied[bx]) {
+          first[0] = std::min(first[0], bx);
+          last[0] = std::max(last[0], bx);
+          first[1] = std::min(first[1], by);
+          last[1] = std::max(last[1], by);
+        }
+      }
+    }
+  }
+  if (first[0] > last[0]) {
+    return false;
+  }
+
+  const size_t voxelBegin[2] = { std::max<size_t>(first[0] * blockSize, 1) - 1, std::max<size_t>(first[1] * blockSize, 1) - 1 };
+  const size_t voxelEnd[2] = { (last[0] + 1) * blockSize + 1, (last[1] + 1) * blockSize + 1 };
+  xBegin = std::max(voxelBegin[0], origin[0]) - origin[0];
+  xEnd = std::min(voxelEnd[0], origin[0] + extent[0]) - origin[0];
+  yBegin = std::max(voxelBegin[1], origin[1]) - origin[1];
+  yEnd = std::min(voxelEnd[1], origin[1] + extent[1]) - origin[1];
+  return true;
+}
+
+/*****************************************************************/
+
+// Preview: max-pools the selection straight from the labels into a mask of
+// options_.previewDim voxels. A preview voxel is set if any task voxel in its
+// cell is selected, which keeps thin processes connected. Its border voxels
+// stay 0 like the task's, and vertexScale_/vertexOffset_ map the result back
+// to task coordinates. Like selectSegments, `mask` only covers the bounding
+// box of the selection (in preview voxels). Returns false if no voxel is
+// selected.
+template<typename T>
+bool CTaskMesher<T>::downsampleSegments(std::vector<uint8_t> & mask, zi::vl::vec<size_t, 3> & origin,
+                                        zi::vl::vec<size_t, 3> & extent, bool fillHoles) {
+  zi::vl::vec<size_t, 3> previewDim;
+  std::vector<size_t> cells[3];
+  if (!previewCells(previewDim, cells)) {
+    return false;
+  }
+
+  const size_t previewPlane = previewDim[0] * previewDim[1];
+  std::vector<uint8_t> preview;
+  if (scratch_) preview.swap(scratch_->preview);
+  preview.assign(previewPlane * previewDim[2], 0);
+  trackBytes(preview.size());
+
+  // Interior preview planes split between threads, every thread tracks the
+  // bounding box of its own planes
+  const size_t parts = std::max<size_t>(1, std::min(options_.threadCount, previewDim[2] - 2));
+  std::vector<CSelectionBounds> partBounds(parts, CSelectionBounds(previewDim));
+
+  auto poolPlanes = [&](size_t part) {
+    std::vector<uint8_t> row(dim_[0]), pooled(dim_[0]);
+    const zi::vl::vec<size_t, 3> rowExtent(dim_[0], 1, 1);
+    CSelectionBounds & bounds = partBounds[part];
+
+    for (size_t oz = 1 + (previewDim[2] - 2) * part / parts; oz < 1 + (previewDim[2] - 2) * (part + 1) / parts && !aborted(); ++oz) {
+      for (size_t oy = 1; oy < previewDim[1] - 1; ++oy) {
+        // OR the masks of all task rows of the cell row, then pool along x
+        bool first = true;
+        for (size_t z = cells[2][oz]; z < cells[2][oz + 1]; ++z) {
+          for (size_t y = cells[1][oy]; y < cells[1][oy + 1]; ++y) {
+            const zi::vl::vec<size_t, 3> rowOrigin(0, y, z);
+            lookup_.extract(volume_, dim_, rowOrigin, rowExtent, first ? &pooled[0] : &row[0]);
+            if (!first) {
+              for (size_t x = 0; x < dim_[0]; ++x) {
+                pooled[x] |= row[x];
+              }
+            }
+            first = false;
+          }
+        }
+
+        uint8_t * out = &preview[oy * previewDim[0] + oz * previewPlane];
+        size_t count = 0, xFirst = 0, xLast = 0;
+        for (size_t ox = 1; ox < previewDim[0] - 1; ++ox) {
+          uint8_t selected = 0;
+          for (size_t x = cells[0][ox]; x < cells[0][ox + 1]; ++x) {
+            selected |= pooled[x];
+          }
+          out[ox] = selected;
+          if (selected) {
+            if (count == 0) xFirst = ox;
+            xLast = ox;
+            ++count;
+          }
+        }
+
+        if (count > 0) {
+          bounds.min[0] = std::min(bounds.min[0], xFirst);
+          bounds.max[0] = std::max(bounds.max[0], xLast);
+          bounds.min[1] = std::min(bounds.min[1], oy);
+          bounds.max[1] = std::max(bounds.max[1], oy);
+          bounds.min[2] = std::min(bounds.min[2], oz);
+          bounds.max[2] = std::max(bounds.max[2], oz);
+          bounds.voxels += count;
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t part = 1; part < parts; ++part) {
+    workers.push_back(std::thread(poolPlanes, part));
+  }
+  poolPlanes(0);
+  for (auto worker = workers.begin(); worker != workers.end(); ++worker) {
+    worker->join();
+  }
+
+  bboxMin_ = previewDim;
+  bboxMax_ = zi::vl::vec<size_t, 3>(0, 0, 0);
+  for (size_t part = 0; part < parts; ++part) {
+    for (int i = 0; i < 3; ++i) {
+      bboxMin_[i] = std::min(bboxMin_[i], partBounds[part].min[i]);
+      bboxMax_[i] = std::max(bboxMax_[i], partBounds[part].max[i]);
+    }
+    stats_.voxelsSelected += partBounds[part].voxels;
+  }
+  stats_.voxelsScanned = dim_[0] * (cells[1][previewDim[1] - 1] - cells[1][1]) * (cells[2][previewDim[2] - 1] - cells[2][1]);
+
+  if (stats_.voxelsSelected == 0 || aborted()) {
+    trackBytes(-int64_t(preview.size()));
+    if (scratch_) preview.swap(scratch_->preview);
+    return false;
+  }
+
+  cropPreview(preview, previewDim, mask, origin, extent);
+  trackBytes(-int64_t(preview.size()));
+  if (scratch_) preview.swap(scratch_->preview);
+
+  if (fillHoles) {
+    this->fillHoles(mask, extent);
+  }
+
+  return true;
+}
+
+/*****************************************************************/
+
+// Preview grid: task voxels [cells[d][o], cells[d][o + 1]) pool into preview
+// voxel o. Sets vertexScale_/vertexOffset_, returns false if the preview is
+// too small to hold a mesh.
+template<typename T>
+bool CTaskMesher<T>::previewCells(zi::vl::vec<size_t, 3> & previewDim, std::vector<size_t> cells[3]) {
+  for (int d = 0; d < 3; ++d) {
+    previewDim[d] = std::min(options_.previewDim[d], dim_[d]);
+    const double factor = double(dim_[d]) / double(previewDim[d]);
+    cells[d].resize(previewDim[d] + 1);
+    for (size_t o = 0; o <= previewDim[d]; ++o) {
+      cells[d][o] = static_cast<size_t>(o * factor);
+    }
+
+    // Doubled lattice: the centre 2o of preview voxel o goes to the centre of its cell, 2 ((o + 1/2) factor - 1/2)
+    vertexScale_[d] = factor;
+    vertexOffset_[d] = factor - 1.0;
+  }
+  return previewDim[0] >= 3 && previewDim[1] >= 3 && previewDim[2] >= 3;
+}
+
+// Copies the bounding box of the selection (bboxMin_/bboxMax_, in preview
+// voxels) out of the full preview grid
+template<typename T>
+void CTaskMesher<T>::cropPreview(const std::vector<uint8_t> & preview, const zi::vl::vec<size_t, 3> & previewDim, std::vector<uint8_t> & mask,
+                                 zi::vl::vec<size_t, 3> & origin, zi::vl::vec<size_t, 3> & extent) const {
+  const size_t previewPlane = previewDim[0] * previewDim[1];
+  cropBounds(previewDim, origin, extent);
+  mask.resize(extent[0] * extent[1] * extent[2]);
+  for (size_t z = 0; z < extent[2]; ++z) {
+    for (size_t y = 0; y < extent[1]; ++y) {
+      memcpy(&mask[extent[0] * (y + extent[1] * z)],
+             &preview[origin[0] + previewDim[0] * (origin[1] + y) + previewPlane * (origin[2] + z)], extent[0]);
+    }
+  }
+}
+
+/*****************************************************************/
+
+// Counts the set voxels of a 0/1 grid and sets bboxMin_/bboxMax_ to their
+// bounding box
+template<typename T>
+size_t CTaskMesher<T>::gridBounds(const uint8_t * grid, const zi::vl::vec<size_t, 3> & size) {
+  size_t count = 0;
+  bboxMin_ = size;
+  bboxMax_ = zi::vl::vec<size_t, 3>(0, 0, 0);
+  for (size_t z = 0; z < size[2]; ++z) {
+    for (size_t y = 0; y < size[1]; ++y) {
+      const uint8_t * row = grid + size[0] * (y + size[1] * z);
+      size_t rowCount = 0, first = 0, last = 0;
+      for (size_t x = 0; x < size[0]; ++x) {
+        if (row[x]) {
+          if (rowCount == 0) first = x;
+          last = x;
+          ++rowCount;
+        }
+      }
+      if (rowCount > 0) {
+        bboxMin_[0] = std::min(bboxMin_[0], first);
+        bboxMax_[0] = std::max(bboxMax_[0], last);
+        bboxMin_[1] = std::min(bboxMin_[1], y);
+        bboxMax_[1] = std::max(bboxMax_[1], y);
+        bboxMin_[2] = std::min(bboxMin_[2], z);
+        bboxMax_[2] = std::max(bboxMax_[2], z);
+        count += rowCount;
+      }
+    }
+  }
+  return count;
+}
+
+/*****************************************************************/
+
+// Compressed input: only blocks whose label table holds a selected segment
+// are decoded, first for the bounds of the selection, then once more into
+// the cropped mask (previews: pooled into the preview grid and cropped like
+// in downsampleSegments). The mask is the same as for the decoded volume and
+// so is the mesh.
+template<typename T>
+bool CTaskMesher<T>::selectCompressed(std::vector<uint8_t> & mask, zi::vl::vec<size_t, 3> & origin,
+                                      zi::vl::vec<size_t, 3> & extent, bool preview, bool fillHoles) {
+  const CCompressedSegmentation & input = compressed_;
+  const zi::vl::vec<size_t, 3> & grid = input.grid();
+  const zi::vl::vec<size_t, 3> & blockSize = input.blockSize();
+  if (dim_[0] < 3 || dim_[1] < 3 || dim_[2] < 3) {
+    return false;
+  }
+
+  const auto selected = [this](uint64_t label) {
+    return label <= std::numeric_limits<T>::max() && lookup_.contains(T(label));
+  };
+
+  // 1. Label tables only: the range of blocks that may hold a selected voxel
+  std::vector<uint8_t> table;
+  zi::vl::vec<size_t, 3> blockMin(grid), blockMax(0, 0, 0);
+  bool any = false;
+  for (size_t bz = 0, block = 0; bz < grid[2]; ++bz) {
+    if (aborted()) {
+      return false;
+    }
+    for (size_t by = 0; by < grid[1]; ++by) {
+      for (size_t bx = 0; bx < grid[0]; ++bx, ++block) {
+        if (input.selectTable(block, selected, table) > 0) {
+          const zi::vl::vec<size_t, 3> b(bx, by, bz);
+          for (int i = 0; i < 3; ++i) {
+            blockMin[i] = std::min(blockMin[i], b[i]);
+            blockMax[i] = std::max(blockMax[i], b[i]);
+          }
+          any = true;
+        }
+      }
+    }
+  }
+  if (!any) {
+    return false;
+  }
+
+  // Task voxels [boxMin, boxMax) of those blocks, off the task border
+  zi::vl::vec<size_t, 3> boxMin, boxMax;
+  for (int i = 0; i < 3; ++i) {
+    boxMin[i] = std::max<size_t>(blockMin[i] * blockSize[i], 1);
+    boxMax[i] = std::min((blockMax[i] + 1) * blockSize[i], dim_[i] - 1);
+    if (boxMin[i] >= boxMax[i]) {
+      return false;
+    }
+  }
+
+  // Preview: pooled into `pooled`, task voxel x of axis d into preview voxel
+  // cellOf[d][x] (SIZE_MAX on the preview border).
+  zi::vl::vec<size_t, 3> previewDim;
+  std::vector<size_t> cells[3], cellOf[3];
+  std::vector<uint8_t> pooled;
+  if (preview) {
+    if (!previewCells(previewDim, cells)) {
+      return false;
+    }
+    for (int d = 0; d < 3; ++d) {
+      cellOf[d].assign(dim_[d], SIZE_MAX);
+      for (size_t o = 1; o + 1 < previewDim[d]; ++o) {
+        std::fill(cellOf[d].begin() + cells[d][o], cellOf[d].begin() + cells[d][o + 1], o);
+      }
+    }
+    if (scratch_) pooled.swap(scratch_->preview);
+    pooled.assign(previewDim[0] * previewDim[1] * previewDim[2], 0);
+    trackBytes(pooled.size());
+  }
+
+  // Full resolution: only the bounds of the selected voxels are taken here,
+  // the blocks holding some are flagged and decoded again into the mask once
+  // its size is known. Nothing larger than a block is buffered.
+  const zi::vl::vec<size_t, 3> candidates(blockMax[0] + 1 - blockMin[0], blockMax[1] + 1 - blockMin[1], blockMax[2] + 1 - blockMin[2]);
+  std::vector<uint8_t> holds;
+  if (!preview) {
+    holds.assign(candidates[0] * candidates[1] * candidates[2], 0);
+    bboxMin_ = dim_;
+    bboxMax_ = zi::vl::vec<size_t, 3>(0, 0, 0);
+    stats_.voxelsSelected = 0;
+  }
+
+  // Part of `block` inside [low, high)
+  const auto blockPart = [&](size_t bx, size_t by, size_t bz, const zi::vl::vec<size_t, 3> & low, const zi::vl::vec<size_t, 3> & high,
+                             zi::vl::vec<size_t, 3> & blockOrigin, zi::vl::vec<size_t, 3> & first, zi::vl::vec<size_t, 3> & last) {
+    blockOrigin = zi::vl::vec<size_t, 3>(bx * blockSize[0], by * blockSize[1], bz * blockSize[2]);
+    for (int i = 0; i < 3; ++i) {
+      first[i] = std::max(blockOrigin[i], low[i]);
+      last[i] = std::min(blockOrigin[i] + blockSize[i], high[i]);
+    }
+  };
+
+  // 2. Decode the candidate blocks
+  std::vector<uint8_t> decoded(input.blockVoxels());
+  for (size_t bz = blockMin[2]; bz <= blockMax[2] && !aborted(); ++bz) {
+    for (size_t by = blockMin[1]; by <= blockMax[1]; ++by) {
+      for (size_t bx = blockMin[0]; bx <= blockMax[0]; ++bx) {
+        const size_t block = bx + grid[0] * (by + grid[1] * bz);
+        if (input.selectTable(block, selected, table) == 0) {
+          continue;
+        }
+        input.decode(block, table, decoded.data());
+        stats_.voxelsScanned += decoded.size();
+
+        zi::vl::vec<size_t, 3> blockOrigin, first, last;
+        blockPart(bx, by, bz, boxMin, boxMax, blockOrigin, first, last);
+        for (size_t z = first[2]; z < last[2]; ++z) {
+          for (size_t y = first[1]; y < last[1]; ++y) {
+            const uint8_t * row = &decoded[blockSize[0] * ((y - blockOrigin[1]) + blockSize[1] * (z - blockOrigin[2]))];
+            if (preview) {
+              const size_t oy = cellOf[1][y], oz = cellOf[2][z];
+              if (oy == SIZE_MAX || oz == SIZE_MAX) {
+                continue;
+              }
+              uint8_t * out = &pooled[previewDim[0] * (oy + previewDim[1] * oz)];
+              for (size_t x = first[0]; x < last[0]; ++x) {
+                if (row[x - blockOrigin[0]] && cellOf[0][x] != SIZE_MAX) {
+                  out[cellOf[0][x]] = 1;
+                }
+              }
+              continue;
+            }
+
+            size_t rowCount = 0, firstX = 0, lastX = 0;
+            for (size_t x = first[0]; x < last[0]; ++x) {
+              if (row[x - blockOrigin[0]]) {
+                if (rowCount == 0) firstX = x;
+                lastX = x;
+                ++rowCount;
+              }
+            }
+            if (rowCount > 0) {
+              const zi::vl::vec<size_t, 3> low(firstX, y, z), high(lastX, y, z);
+              for (int i = 0; i < 3; ++i) {
+                bboxMin_[i] = std::min(bboxMin_[i], low[i]);
+                bboxMax_[i] = std::max(bboxMax_[i], high[i]);
+              }
+              stats_.voxelsSelected += rowCount;
+              holds[(bx - blockMin[0]) + candidates[0] * ((by - blockMin[1]) + candidates[1] * (bz - blockMin[2]))] = 1;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // 3. Crop to the selection
+  if (preview) {
+    stats_.voxelsSelected = aborted() ? 0 : gridBounds(pooled.data(), previewDim);
+    if (stats_.voxelsSelected > 0) {
+      cropPreview(pooled, previewDim, mask, origin, extent);
+    }
+    trackBytes(-int64_t(pooled.size()));
+    if (scratch_) pooled.swap(scratch_->preview);
+  } else {
+    if (aborted()) {
+      stats_.voxelsSelected = 0;
+    }
+    if (stats_.voxelsSelected > 0) {
+      cropBounds(dim_, origin, extent);
+      mask.assign(extent[0] * extent[1] * extent[2], 0);
+      const zi::vl::vec<size_t, 3> selectedEnd(bboxMax_[0] + 1, bboxMax_[1] + 1, bboxMax_[2] + 1);
+      for (size_t bz = blockMin[2]; bz <= blockMax[2]; ++bz) {
+        for (size_t by = blockMin[1]; by <= blockMax[1]; ++by) {
+          for (size_t bx = blockMin[0]; bx <= blockMax[0]; ++bx) {
+            if (!holds[(bx - blockMin[0]) + candidates[0] * ((by - blockMin[1]) + candidates[1] * (bz - blockMin[2]))]) {
+              continue;
+            }
+            const size_t block = bx + grid[0] * (by + grid[1] * bz);
+            input.selectTable(block, selected, table);
+            input.decode(block, table, decoded.data());
+            stats_.voxelsScanned += decoded.size();
+
+            zi::vl::vec<size_t, 3> blockOrigin, first, last;
+            blockPart(bx, by, bz, bboxMin_, selectedEnd, blockOrigin, first, last);
+            for (size_t z = first[2]; z < last[2]; ++z) {
+              for (size_t y = first[1]; y < last[1]; ++y) {
+                memcpy(&mask[(first[0] - origin[0]) + extent[0] * ((y - origin[1]) + extent[1] * (z - origin[2]))],
+                       &decoded[(first[0] - blockOrigin[0]) + blockSize[0] * ((y - blockOrigin[1]) + blockSize[1] * (z - blockOrigin[2]))],
+                       last[0] - first[0]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  if (stats_.voxelsSelected == 0) {
+    return false;
+  }
+
+  if (fillHoles) {
+    this->fillHoles(mask, extent);
+  }
+
+  return true;
+}
+
+/*****************************************************************/
+
+template<typename T>
+bool CTaskMesher<T>::GetMesh(uint8_t lod, const char ** data, size_t * length)
+{
+  if (lod < 1 + miplevels_) {
+    if (!isBuilt(lod)) {
+      buildLod(lod);
+    }
+
+    std::lock_guard<std::mutex> state(stateMutex_);
+    if (meshData_[lod] && GetStatus() == TASKMESHER_RESULT_OK) {
+      *length = meshLength_[lod];
+      *data   = meshData_[lod];
+    } else {
+      *length = 0;
+      *data = empty_mesh;
+    }
+    return true;
+  }
+  return false;
+}
+
+/*****************************************************************/
+
+template<typename T>
+bool CTaskMesher<T>::GetIndexedMesh(uint8_t lod, const char ** data, size_t * length)
+{
+  if (lod < 1 + miplevels_) {
+    if (!isBuilt(lod)) {
+      buildLod(lod);
+    }
+
+    std::lock_guard<std::mutex> state(stateMutex_);
+    if (indexedData_[lod] && GetStatus() == TASKMESHER_RESULT_OK) {
+      *length = indexedLength_[lod];
+      *data   = indexedData_[lod];
+    } else {
+      *length = 0;
+      *data = empty_mesh;
+    }
+    return true;
+  }
+  return false;
+}
+
+/*****************************************************************/
+
+template<typename T>
+bool CTaskMesher<T>::Serialize(uint64_t key, std::vector<char> & blob)
+{
+  if (!isBuilt(miplevels_)) {
+    buildLod(miplevels_);
+  }
+
+  std::lock_guard<std::mutex> state(stateMutex_);
+  if (GetStatus() != TASKMESHER_RESULT_OK) {
+    return false;
+  }
+
+  const uint64_t dim[3] = { dim_[0], dim_[1], dim_[2] };
+  CMeshBlobWriter writer(key, dim, sizeof(T), 1 + miplevels_, blob_ ? blob_->header().formats : options_.outputFormats);
+  writer.add(reinterpret_cast<const char *>(&stats_), sizeof(stats_));
+  for (int lod = 0; lod < 1 + miplevels_; ++lod) {
+    writer.add(meshData_[lod], meshData_[lod] ? meshLength_[lod] : 0);
+    writer.add(indexedData_[lod], indexedData_[lod] ? indexedLength_[lod] : 0);
+  }
+  writer.write(blob);
+  return true;
+}
+
+/*****************************************************************/
+
+// Hash of everything but the labels
+template<typename T>
+uint64_t MeshCacheSeed(const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount, const CTaskMesherOptions & options)
+{
+  // Deferred LOD modes always simplify sequentially
+  const bool independentLods = options.independentLods && options.lodMode == TASKMESHER_LOD_EAGER;
+  const uint64_t params[] = { MESH_BLOB_VERSION, sizeof(T), dim[0], dim[1], dim[2], mipCount, options.outputFormats, options.fillHoles,
+                              independentLods, options.previewDim[0], options.previewDim[1], options.previewDim[2], options.lodPolicy };
+  const std::set<T> sorted(segments.begin(), segments.end());
+  const std::vector<T> unique(sorted.begin(), sorted.end());
+
+  uint64_t h = HashBytes(params, sizeof(params));
+  h = HashBytes(&options.transform, sizeof(options.transform), h);
+  if (options.lodPolicy != TASKMESHER_LOD_POLICY_RATIO) {
+    h = HashBytes(options.lodTargets.data(), options.lodTargets.size() * sizeof(double), h);
+  }
+  return HashBytes(unique.data(), unique.size() * sizeof(T), h);
+}
+
+template<typename T>
+uint64_t MeshCacheKey(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options)
+{
+  return HashBytes(segmentation, dim[0] * dim[1] * dim[2] * sizeof(T), MeshCacheSeed(dim, segments, mipCount, options));
+}
+
+template<typename T>
+uint64_t MeshCacheKey(const CCompressedSegmentation & segmentation, const std::vector<T> & segments, uint8_t mipCount,
+                      const CTaskMesherOptions & options)
+{
+  const zi::vl::vec<size_t, 3> & blockSize = segmentation.blockSize();
+  const uint64_t layout[] = { blockSize[0], blockSize[1], blockSize[2], segmentation.labelWords() };
+  const uint64_t h = HashBytes(layout, sizeof(layout), MeshCacheSeed(segmentation.dim(), segments, mipCount, options));
+  return HashBytes(segmentation.data(), segmentation.words() * sizeof(uint32_t), h);
+}
+
+/*****************************************************************/
+
+template<typename T>
+CTaskMesherBatch<T>::CTaskMesherBatch(const T * segmentation, const zi::vl::vec<size_t, 3> & dim, const std::vector<std::vector<T>> & groups,
+                                      uint8_t mipCount, const CTaskMesherOptions & options) :
+meshers_(groups.size())
+{
+  const size_t threads = std::max<size_t>(1, options.threadCount);
+
+  // 1. Bounding boxes of all groups, z-slabs in parallel
+  std::vector<CSelectionBounds> bounds(groups.size(), CSelectionBounds(dim));
+  {
+    const CSegmentGroupTable<T> table(groups);
+    const size_t slabs = std::max<size_t>(1, std::min(threads, dim[2]));
+    std::vector<std::vector<CSelectionBounds>> partial(slabs, bounds);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < slabs; ++i) {
+      workers.emplace_back([&, i]() {
+        table.bounds(segmentation, dim, dim[2] * i / slabs, dim[2] * (i + 1) / slabs, partial[i]);
+      });
+    }
+    table.bounds(segmentation, dim, 0, dim[2] / slabs, partial[0]);
+    for (auto & worker : workers) {
+      worker.join();
+    }
+
+    for (size_t i = 0; i < slabs; ++i) {
+      for (size_t g = 0; g < groups.size(); ++g) {
+        for (int d = 0; d < 3; ++d) {
+          bounds[g].min[d] = std::min(bounds[g].min[d], partial[i][g].min[d]);
+          bounds[g].max[d] = std::max(bounds[g].max[d], partial[i][g].max[d]);
+        }
+        bounds[g].voxels += partial[i][g].voxels;
+      }
+    }
+  }
+
+  // 2. Mask and mesh every group on its own bounding box, threads left over
+  // when there are fewer groups than threads go to the groups' slabs
+  const size_t workerCount = std::max<size_t>(1, std::min(threads, groups.size()));
+  CTaskMesherOptions groupOptions(options);
+  groupOptions.threadCount = threads / workerCount;
+
+  std::atomic<size_t> next(0);
+  auto work = [&]() {
+    for (size_t g = next++; g < groups.size(); g = next++) {
+      meshers_[g].reset(new CTaskMesher<T>(segmentation, dim, groups[g], mipCount, bounds[g], groupOptions));
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < workerCount; ++i) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto & worker : workers) {
+    worker.join();
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+bool CTaskMesherBatch<T>::Disjoint(const std::vector<std::vector<T>> & groups)
+{
+  std::set<T> seen;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const std::set<T> group(groups[g].begin(), groups[g].end());
+    for (auto it = group.begin(); it != group.end(); ++it) {
+      if (!seen.insert(*it).second) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
@@ -26,8 +26,11 @@ lzma.setPromiseAPI(Promise);
 
 // Typedefs
 const TaskMesherPtr = ref.refType(ref.types.void);
+const TaskMesherOptionsPtr = ref.refType(ref.types.void);
+const TaskMesherEnginePtr = ref.refType(ref.types.void);
 const SizeTArray = ArrayType(ref.types.size_t);
 const FloatArray = ArrayType(ref.types.float);
+const DoubleArray = ArrayType(ref.types.double);
 const UInt8Ptr = ref.refType(ref.types.uint8);
 const UInt16Ptr = ref.refType(ref.types.uint16);
 const UInt32Ptr = ref.refType(ref.types.uint32);
@@ -42,6 +45,55 @@ const TaskMesherLib = ffi.Library('../lib/librtm', {
     "TaskMesher_Generate_uint16": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt16Ptr, "uint16", "uint8" ] ],
     "TaskMesher_Generate_uint32": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt32Ptr, "uint32", "uint8" ] ],
 
+    // TMesher * TaskMesher_GenerateWithOptions_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+    "TaskMesher_GenerateWithOptions_uint8": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt8Ptr, "uint8", "uint8", TaskMesherOptionsPtr ] ],
+    "TaskMesher_GenerateWithOptions_uint16": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt16Ptr, "uint16", "uint8", TaskMesherOptionsPtr ] ],
+    "TaskMesher_GenerateWithOptions_uint32": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt32Ptr, "uint32", "uint8", TaskMesherOptionsPtr ] ],
+
+    // TMesher * TaskMesher_GenerateInPlace_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+    "TaskMesher_GenerateInPlace_uint8": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt8Ptr, "uint8", "uint8", TaskMesherOptionsPtr ] ],
+    "TaskMesher_GenerateInPlace_uint16": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt16Ptr, "uint16", "uint8", TaskMesherOptionsPtr ] ],
+    "TaskMesher_GenerateInPlace_uint32": [ TaskMesherPtr, [ UCharPtr, SizeTArray, UInt32Ptr, "uint32", "uint8", TaskMesherOptionsPtr ] ],
+
+    // TMesherEngine * TaskMesher_CreateEngine(uint8_t threadCount, TaskMesherJobDone done, void * userData);
+    "TaskMesher_CreateEngine": [ TaskMesherEnginePtr, [ "uint8", "pointer", "pointer" ] ],
+    "TaskMesher_ReleaseEngine": [ "void", [ TaskMesherEnginePtr ] ],
+
+    // uint64_t TaskMesher_Submit_uint8(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key);
+    "TaskMesher_Submit_uint8": [ "uint64", [ TaskMesherEnginePtr, UCharPtr, SizeTArray, UInt8Ptr, "uint8", "uint8", TaskMesherOptionsPtr, "int32", "uint64" ] ],
+    "TaskMesher_Submit_uint16": [ "uint64", [ TaskMesherEnginePtr, UCharPtr, SizeTArray, UInt16Ptr, "uint16", "uint8", TaskMesherOptionsPtr, "int32", "uint64" ] ],
+    "TaskMesher_Submit_uint32": [ "uint64", [ TaskMesherEnginePtr, UCharPtr, SizeTArray, UInt32Ptr, "uint32", "uint8", TaskMesherOptionsPtr, "int32", "uint64" ] ],
+    "TaskMesher_PollJob": [ "uint8", [ TaskMesherEnginePtr, "uint64" ] ],
+    "TaskMesher_CancelJob": [ "uint8", [ TaskMesherEnginePtr, "uint64" ] ],
+    "TaskMesher_TakeJob": [ TaskMesherPtr, [ TaskMesherEnginePtr, "uint64" ] ],
+
+    // uint64_t TaskMesher_CacheKey_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options);
+    "TaskMesher_CacheKey_uint8": [ "uint64", [ UCharPtr, SizeTArray, UInt8Ptr, "uint8", "uint8", TaskMesherOptionsPtr ] ],
+    "TaskMesher_CacheKey_uint16": [ "uint64", [ UCharPtr, SizeTArray, UInt16Ptr, "uint16", "uint8", TaskMesherOptionsPtr ] ],
+    "TaskMesher_CacheKey_uint32": [ "uint64", [ UCharPtr, SizeTArray, UInt32Ptr, "uint32", "uint8", TaskMesherOptionsPtr ] ],
+
+    // uint8_t   TaskMesher_SaveCache_uint8(TMesher * taskmesher, uint64_t key, const char * path);
+    "TaskMesher_SaveCache_uint8": [ "uint8", [ TaskMesherPtr, "uint64", "string" ] ],
+    "TaskMesher_SaveCache_uint16": [ "uint8", [ TaskMesherPtr, "uint64", "string" ] ],
+    "TaskMesher_SaveCache_uint32": [ "uint8", [ TaskMesherPtr, "uint64", "string" ] ],
+
+    // TMesher * TaskMesher_LoadCache_uint8(const char * path, uint64_t key);
+    "TaskMesher_LoadCache_uint8": [ TaskMesherPtr, [ "string", "uint64" ] ],
+    "TaskMesher_LoadCache_uint16": [ TaskMesherPtr, [ "string", "uint64" ] ],
+    "TaskMesher_LoadCache_uint32": [ TaskMesherPtr, [ "string", "uint64" ] ],
+
+    // TMesherOptions * TaskMesher_CreateOptions();
+    "TaskMesher_CreateOptions": [ TaskMesherOptionsPtr, [ ] ],
+    "TaskMesher_ReleaseOptions": [ "void", [ TaskMesherOptionsPtr ] ],
+    "TaskMesher_SetIndependentLods": [ "void", [ TaskMesherOptionsPtr, "uint8" ] ],
+    "TaskMesher_SetThreadCount": [ "void", [ TaskMesherOptionsPtr, "uint8" ] ],
+    "TaskMesher_SetOutputFormats": [ "void", [ TaskMesherOptionsPtr, "uint8" ] ],
+    "TaskMesher_SetLodMode": [ "void", [ TaskMesherOptionsPtr, "uint8" ] ],
+    "TaskMesher_SetVerbose": [ "void", [ TaskMesherOptionsPtr, "uint8" ] ],
+    "TaskMesher_SetFillHoles": [ "void", [ TaskMesherOptionsPtr, "uint8" ] ],
+    "TaskMesher_SetPreview": [ "void", [ TaskMesherOptionsPtr, SizeTArray ] ],
+    "TaskMesher_SetLodPolicy": [ "void", [ TaskMesherOptionsPtr, "uint8", DoubleArray, "uint8" ] ],
+
     // void      TaskMesher_Release_uint8(TMesher * taskmesher);
     "TaskMesher_Release_uint8": [ "void", [ TaskMesherPtr ] ],
     "TaskMesher_Release_uint16": [ "void", [ TaskMesherPtr ] ],
@@ -57,6 +109,16 @@ const TaskMesherLib = ffi.Library('../lib/librtm', {
     "TaskMesher_GetSimplifiedMesh_uint16": [ "void", [ TaskMesherPtr , "uint8", CharPtrPtr, SizeTPtr ] ],
     "TaskMesher_GetSimplifiedMesh_uint32": [ "void", [ TaskMesherPtr , "uint8", CharPtrPtr, SizeTPtr ] ],
 
+    //void      TaskMesher_GetRawIndexedMesh_uint8(TMesher * taskmesher, char ** data, size_t * length);
+    "TaskMesher_GetRawIndexedMesh_uint8": [ "void", [ TaskMesherPtr, CharPtrPtr, SizeTPtr ] ],
+    "TaskMesher_GetRawIndexedMesh_uint16": [ "void", [ TaskMesherPtr, CharPtrPtr, SizeTPtr ] ],
+    "TaskMesher_GetRawIndexedMesh_uint32": [ "void", [ TaskMesherPtr, CharPtrPtr, SizeTPtr ] ],
+
+    //void      TaskMesher_GetSimplifiedIndexedMesh_uint8(TMesher * taskmesher, uint8_t lod, char ** data, size_t * length);
+    "TaskMesher_GetSimplifiedIndexedMesh_uint8": [ "void", [ TaskMesherPtr , "uint8", CharPtrPtr, SizeTPtr ] ],
+    "TaskMesher_GetSimplifiedIndexedMesh_uint16": [ "void", [ TaskMesherPtr , "uint8", CharPtrPtr, SizeTPtr ] ],
+    "TaskMesher_GetSimplifiedIndexedMesh_uint32": [ "void", [ TaskMesherPtr , "uint8", CharPtrPtr, SizeTPtr ] ],
+
     //void      TaskMesher_ScaleVolume_uint8(unsigned char * in_volume, size_t from_dim[3], size_t to_dim[3], unsigned char * out_buffer)
     "TaskMesher_ScaleVolume_uint8": [ "void", [ UCharPtr, SizeTArray, SizeTArray, UCharPtr] ],
     "TaskMesher_ScaleVolume_uint16": [ "void", [ UCharPtr, SizeTArray, SizeTArray, UCharPtr] ],
@@ -66,38 +128,61 @@ const TaskMesherLib = ffi.Library('../lib/librtm', {
     "TaskMesher_ScaleMesh_uint8": [ "void", [ TaskMesherPtr, FloatArray] ],
     "TaskMesher_ScaleMesh_uint16": [ "void", [ TaskMesherPtr, FloatArray] ],
     "TaskMesher_ScaleMesh_uint32": [ "void", [ TaskMesherPtr, FloatArray] ],
+
+    //void      TaskMesher_GetStats_uint8(TMesher * taskmesher, TaskMesherStats * stats)
+    "TaskMesher_GetStats_uint8": [ "void", [ TaskMesherPtr, UCharPtr] ],
+    "TaskMesher_GetStats_uint16": [ "void", [ TaskMesherPtr, UCharPtr] ],
+    "TaskMesher_GetStats_uint32": [ "void", [ TaskMesherPtr, UCharPtr] ],
 });
 
 const typeLookup = {
     uint8: {
         constructor: Uint8Array,
         size: 1,
-        generate: TaskMesherLib.TaskMesher_Generate_uint8,
+        submit: TaskMesherLib.TaskMesher_Submit_uint8,
+        cacheKey: TaskMesherLib.TaskMesher_CacheKey_uint8,
+        saveCache: TaskMesherLib.TaskMesher_SaveCache_uint8,
+        loadCache: TaskMesherLib.TaskMesher_LoadCache_uint8,
         release: TaskMesherLib.TaskMesher_Release_uint8,
         getRawMesh: TaskMesherLib.TaskMesher_GetRawMesh_uint8,
         getSimplifiedMesh: TaskMesherLib.TaskMesher_GetSimplifiedMesh_uint8,
+        getRawIndexedMesh: TaskMesherLib.TaskMesher_GetRawIndexedMesh_uint8,
+        getSimplifiedIndexedMesh: TaskMesherLib.TaskMesher_GetSimplifiedIndexedMesh_uint8,
         scaleVolume: TaskMesherLib.TaskMesher_ScaleVolume_uint8,
-        scaleMesh: TaskMesherLib.TaskMesher_ScaleMesh_uint8
+        scaleMesh: TaskMesherLib.TaskMesher_ScaleMesh_uint8,
+        getStats: TaskMesherLib.TaskMesher_GetStats_uint8
     },
     uint16: {
         constructor: Uint16Array,
         size: 2,
-        generate: TaskMesherLib.TaskMesher_Generate_uint16,
+        submit: TaskMesherLib.TaskMesher_Submit_uint16,
+        cacheKey: TaskMesherLib.TaskMesher_CacheKey_uint16,
+        saveCache: TaskMesherLib.TaskMesher_SaveCache_uint16,
+        loadCache: TaskMesherLib.TaskMesher_LoadCache_uint16,
         release: TaskMesherLib.TaskMesher_Release_uint16,
         getRawMesh: TaskMesherLib.TaskMesher_GetRawMesh_uint16,
         getSimplifiedMesh: TaskMesherLib.TaskMesher_GetSimplifiedMesh_uint16,
+        getRawIndexedMesh: TaskMesherLib.TaskMesher_GetRawIndexedMesh_uint16,
+        getSimplifiedIndexedMesh: TaskMesherLib.TaskMesher_GetSimplifiedIndexedMesh_uint16,
         scaleVolume: TaskMesherLib.TaskMesher_ScaleVolume_uint16,
-        scaleMesh: TaskMesherLib.TaskMesher_ScaleMesh_uint16
+        scaleMesh: TaskMesherLib.TaskMesher_ScaleMesh_uint16,
+        getStats: TaskMesherLib.TaskMesher_GetStats_uint16
     },
     uint32: {
         constructor: Uint32Array,
         size: 4,
-        generate: TaskMesherLib.TaskMesher_Generate_uint32,
+        submit: TaskMesherLib.TaskMesher_Submit_uint32,
+        cacheKey: TaskMesherLib.TaskMesher_CacheKey_uint32,
+        saveCache: TaskMesherLib.TaskMesher_SaveCache_uint32,
+        loadCache: TaskMesherLib.TaskMesher_LoadCache_uint32,
         release: TaskMesherLib.TaskMesher_Release_uint32,
         getRawMesh: TaskMesherLib.TaskMesher_GetRawMesh_uint32,
         getSimplifiedMesh: TaskMesherLib.TaskMesher_GetSimplifiedMesh_uint32,
+        getRawIndexedMesh: TaskMesherLib.TaskMesher_GetRawIndexedMesh_uint32,
+        getSimplifiedIndexedMesh: TaskMesherLib.TaskMesher_GetSimplifiedIndexedMesh_uint32,
         scaleVolume: TaskMesherLib.TaskMesher_ScaleVolume_uint32,
-        scaleMesh: TaskMesherLib.TaskMesher_ScaleMesh_uint32
+        scaleMesh: TaskMesherLib.TaskMesher_ScaleMesh_uint32,
+        getStats: TaskMesherLib.TaskMesher_GetStats_uint32
     }
 };
 
@@ -157,68 +242,213 @@ function cachedFetch(request) {
         });
 }
 
-/* scaleVolume
- * 
- * Input: `volume` is a Buffer which we are scaling from `from_dimensions` to `to_dimensions`.
+// Threads used inside a single remesh. Requests already run concurrently (see
+// MAX_PROCESSING_COUNT), so this trades latency of one task against throughput.
+const MESH_THREADS = Math.min(Math.max(process.env.MESH_THREADS || 1, 1), 255);
+const meshOptions = TaskMesherLib.TaskMesher_CreateOptions();
+TaskMesherLib.TaskMesher_SetThreadCount(meshOptions, MESH_THREADS);
+
+// Simplified LODs are built on a background thread inside the mesher, so
+// generate returns as soon as the full resolution mesh exists. Fetching a LOD
+// that isn't done yet blocks, which is why getMesh below always runs async.
+const TASKMESHER_LOD_BACKGROUND = 2;
+TaskMesherLib.TaskMesher_SetLodMode(meshOptions, TASKMESHER_LOD_BACKGROUND);
+
+// Optional "lod_byte_budgets" in rtm.config.json, bytes of LOD 1, 2, ..., caps
+// what a simplified LOD takes in the bucket and to download. LODs past the
+// list keep the fixed face ratios.
+const TASKMESHER_LOD_POLICY_BYTES = 3;
+function setLodBudgets(options) {
+    const budgets = rtm_config.lod_byte_budgets;
+    if (Array.isArray(budgets) && budgets.length > 0) {
+        TaskMesherLib.TaskMesher_SetLodPolicy(options, TASKMESHER_LOD_POLICY_BYTES, new DoubleArray(budgets), budgets.length);
+    }
+}
+setLodBudgets(meshOptions);
+
+// Same as meshOptions, but cavities enclosed by the segments are meshed as solid
+const meshOptionsFillHoles = TaskMesherLib.TaskMesher_CreateOptions();
+TaskMesherLib.TaskMesher_SetThreadCount(meshOptionsFillHoles, MESH_THREADS);
+TaskMesherLib.TaskMesher_SetLodMode(meshOptionsFillHoles, TASKMESHER_LOD_BACKGROUND);
+TaskMesherLib.TaskMesher_SetFillHoles(meshOptionsFillHoles, 1);
+setLodBudgets(meshOptionsFillHoles);
+
+/* previewOptions
  *
- * Description: Used for downscaling large segmentations to create a quick preview.
- *              Scaling is lazy, speed linear wrt to `to_dimensions`.
+ * Description: Options for a quick preview, the mesher max-pools the segmentation down to `preview`
+ *              dimensions itself and returns vertices in full resolution coordinates.
+ *              Release with TaskMesher_ReleaseOptions.
  */
-function scaleVolume(volume, intType, from_dimensions, to_dimensions) {
+function previewOptions(preview, fillHoles) {
+    const options = TaskMesherLib.TaskMesher_CreateOptions();
+    TaskMesherLib.TaskMesher_SetThreadCount(options, MESH_THREADS);
+    TaskMesherLib.TaskMesher_SetFillHoles(options, fillHoles ? 1 : 0);
+    setLodBudgets(options);
+
+    const previewArray = new SizeTArray(3);
+    previewArray[0] = preview.x;
+    previewArray[1] = preview.y;
+    previewArray[2] = preview.z;
+    TaskMesherLib.TaskMesher_SetPreview(options, previewArray);
+    return options;
+}
+
+/* meshInputs
+ *
+ * Description: Native arguments shared by all calls that mesh `segments` of a task. `options` has
+ *              to be passed to releaseOptions once the native side is done with it.
+ */
+function meshInputs(dimensions, segments, intType, fillHoles, preview) {
+    const segmentsTA = new intType.constructor(segments);
+    const segmentsBuffer = Buffer.from(segmentsTA.buffer);
+    segmentsBuffer.type = ref.types[intType];
+
+    const dimensionsArray = new SizeTArray(3);
+    dimensionsArray[0] = dimensions.x;
+    dimensionsArray[1] = dimensions.y;
+    dimensionsArray[2] = dimensions.z;
+
+    const options = preview ? previewOptions(preview, fillHoles) : (fillHoles ? meshOptionsFillHoles : meshOptions);
+    return {
+        segmentsBuffer,
+        segmentCount: segmentsTA.length,
+        dimensionsArray,
+        options,
+        releaseOptions: () => { if (preview) TaskMesherLib.TaskMesher_ReleaseOptions(options); }
+    };
+}
+
+/* generateMeshes
+ *
+ * Description: Queues `segmentation` on the mesher engine without copying it. The buffer is only
+ *              read and must not be modified until the job is final. With `preview`, a downsampled
+ *              mesh of those dimensions is generated instead. A newer job with the same `key`
+ *              supersedes this one, the promise then resolves with null.
+ */
+function generateMeshes(segmentation, dimensions, segments, mipCount, intType, fillHoles, preview, priority, key) {
     return new Promise((fulfill, reject) => {
-        const fromDimArray = new SizeTArray(3);
-        fromDimArray[0] = from_dimensions.x;
-        fromDimArray[1] = from_dimensions.y;
-        fromDimArray[2] = from_dimensions.z;
-
-        const toDimArray = new SizeTArray(3);
-        toDimArray[0] = to_dimensions.x;
-        toDimArray[1] = to_dimensions.y;
-        toDimArray[2] = to_dimensions.z;
-       
-        downscaled = new Buffer(intType.size * to_dimensions.x * to_dimensions.y * to_dimensions.z);
-        intType.scaleVolume.async(volume, fromDimArray, toDimArray, downscaled, function (err, success) {
-            if (err) reject(err);
-            else fulfill(downscaled);
-        });
+        const { segmentsBuffer, segmentCount, dimensionsArray, options, releaseOptions } = meshInputs(dimensions, segments, intType, fillHoles, preview);
+
+        // Options are copied on submit
+        const job = intType.submit(meshEngine, segmentation, dimensionsArray, segmentsBuffer, segmentCount, mipCount, options, priority, key);
+        releaseOptions();
+
+        // Keeps the buffers referenced until the engine is done with them
+        pendingJobs.set(job, { fulfill, reject, segmentation, segmentsBuffer });
     });
 }
 
-/* scaleMesh
- * 
- * Input: ...
+// Finished meshes are kept as mesh blobs in this directory (local disk, or shared between nodes),
+// so repeated remeshes and restarts skip meshing. Unset: no mesh cache.
+const MESH_CACHE_DIR = process.env.MESH_CACHE_DIR;
+if (MESH_CACHE_DIR) mkdirp.sync(MESH_CACHE_DIR);
+
+function meshCachePath(type, key) {
+    return `${MESH_CACHE_DIR}/${type}_${key}.rtmb`;
+}
+
+/* loadCachedMeshes
  *
- * Description: Scales the vertex positions by scaleFactor. Does not change the vertex normals (bad)!
+ * Description: Hashes `segmentation` and the other mesh inputs on the libuv threadpool and maps the
+ *              matching mesh blob. Resolves with { key, mesher }, where mesher is null on a miss and
+ *              key is null without MESH_CACHE_DIR.
  */
-function scaleMesh(mesher, intType, scaleFactor) {
+function loadCachedMeshes(segmentation, dimensions, segments, mipCount, type, fillHoles, preview) {
+    if (!MESH_CACHE_DIR) return Promise.resolve({ key: null, mesher: null });
+
     return new Promise((fulfill, reject) => {
-        const scaleArray = new FloatArray(3);
-        scaleArray[0] = scaleFactor[0];
-        scaleArray[1] = scaleFactor[1];
-        scaleArray[2] = scaleFactor[2];
-       
-        intType.scaleMesh.async(mesher, scaleArray, function (err, success) {
-            if (err) reject(err);
-            else fulfill(mesher);
+        const intType = typeLookup[type];
+        const { segmentsBuffer, segmentCount, dimensionsArray, options, releaseOptions } = meshInputs(dimensions, segments, intType, fillHoles, preview);
+
+        intType.cacheKey.async(segmentation, dimensionsArray, segmentsBuffer, segmentCount, mipCount, options, function (err, key) {
+            releaseOptions();
+            if (err) return reject(err);
+
+            intType.loadCache.async(meshCachePath(type, key), key, function (err, mesher) {
+                if (err) return reject(err);
+                fulfill({ key, mesher: mesher.isNull() ? null : mesher });
+            });
         });
     });
 }
 
-function generateMeshes(segmentation, dimensions, segments, mipCount, intType) {
+/* saveCachedMeshes
+ *
+ * Description: Writes all LODs of `mesher` to the mesh cache. Waits for LODs that are still being
+ *              simplified, so `mesher` must not be released before the promise settles.
+ */
+function saveCachedMeshes(mesher, type, key) {
     return new Promise((fulfill, reject) => {
-        const segmentsTA = new intType.constructor(segments);
-        const segmentsBuffer = Buffer.from(segmentsTA.buffer);
-        segmentsBuffer.type = ref.types[intType];
+        typeLookup[type].saveCache.async(mesher, key, meshCachePath(type, key), function (err, saved) {
+            if (err) return reject(err);
+            if (!saved) return reject(new Error('Could not write mesh blob ' + meshCachePath(type, key)));
+            fulfill();
+        });
+    });
+}
 
-        const dimensionsArray = new SizeTArray(3);
-        dimensionsArray[0] = dimensions.x;
-        dimensionsArray[1] = dimensions.y;
-        dimensionsArray[2] = dimensions.z;
+// Layout of TaskMesherStats (TaskMesher.h), all fields are 8 bytes
+const STAGE_NAMES = ['mask', 'marchingCubes', 'prepare', 'simplify', 'serialize'];
+const STATS_MAX_LODS = 256;
+const STATS_COUNTERS_OFFSET = 2 * STAGE_NAMES.length * 8;
+const STATS_LODS_OFFSET = STATS_COUNTERS_OFFSET + 5 * 8;
+const STATS_SIZE = STATS_LODS_OFFSET + 5 * STATS_MAX_LODS * 8;
 
+/* getStats
+ *
+ * Description: Reads the per stage timings and counters of `mesher`. LODs that are
+ *              still being built in the background are not included yet.
+ */
+function getStats(mesher, intType) {
+    const buf = Buffer.alloc(STATS_SIZE);
+    intType.getStats(mesher, buf);
+
+    const u64 = (offset) => ref.types.uint64.get(buf, offset);
+    const stats = {
+        wallTime: {},
+        cpuTime: {},
+        voxelsScanned: u64(STATS_COUNTERS_OFFSET),
+        voxelsSelected: u64(STATS_COUNTERS_OFFSET + 8),
+        mcTriangles: u64(STATS_COUNTERS_OFFSET + 16),
+        peakBytes: u64(STATS_COUNTERS_OFFSET + 24),
+        lods: []
+    };
+    STAGE_NAMES.forEach((name, i) => {
+        stats.wallTime[name] = buf.readDoubleLE(8 * i);
+        stats.cpuTime[name] = buf.readDoubleLE(8 * (STAGE_NAMES.length + i));
+    });
 
-        intType.generate.async(segmentation, dimensionsArray, segmentsBuffer, segmentsTA.length, mipCount, function (err, mesher) {
-            if (err) reject(err);
-            else fulfill(mesher);
+    const lodCount = u64(STATS_COUNTERS_OFFSET + 32);
+    for (let lod = 0; lod < lodCount; ++lod) {
+        stats.lods.push({
+            faces: u64(STATS_LODS_OFFSET + 8 * lod),
+            vertices: u64(STATS_LODS_OFFSET + 8 * (STATS_MAX_LODS + lod)),
+            bytes: u64(STATS_LODS_OFFSET + 8 * (2 * STATS_MAX_LODS + lod)),
+            acmr: buf.readDoubleLE(STATS_LODS_OFFSET + 8 * (3 * STATS_MAX_LODS + lod)),
+            stripVerticesPerTriangle: buf.readDoubleLE(STATS_LODS_OFFSET + 8 * (4 * STATS_MAX_LODS + lod))
+        });
+    }
+    return stats;
+}
+
+/* getMesh
+ *
+ * Description: Copies the degenerate strip of `lod` out of the mesher. Runs on the libuv
+ *              threadpool since the level may still be simplified in the background.
+ */
+function getMesh(mesher, intType, lod) {
+    return new Promise((fulfill, reject) => {
+        const lengthPtr = ref.alloc(ref.types.size_t);
+        const dataPtr = ref.alloc(CharPtr);
+
+        intType.getSimplifiedMesh.async(mesher, lod, dataPtr, lengthPtr, function (err) {
+            if (err) return reject(err);
+
+            const len = lengthPtr.deref();
+            const data = ref.reinterpret(dataPtr.deref(), len);
+            const buf = new Buffer(len);
+            data.copy(buf, 0, 0, len); // Without this nonsense I get { [Error: EFAULT: bad address in system call argument, write] errno: -14, code: 'EFAULT', syscall: 'write' }
+            fulfill(buf);
         });
     });
 }
@@ -232,7 +462,7 @@ let processCount = 0;
 function processRemesh(params) {
     return new Promise((fulfill, reject) => {
         const start = Date.now();
-        const {task_id, cell_id, type, task_dim, bucket, path, segments, preview} = params;
+        const {task_id, cell_id, type, task_dim, bucket, path, segments, preview, fill_holes} = params;
         console.log("Remeshing task " + task_id);
 
         const segmentation_path = `https://storage.googleapis.com/${bucket}/${path}`;
@@ -241,82 +471,95 @@ function processRemesh(params) {
         const processId = processCount++;
         syncMap.set(task_id, processId);
 
+        let cacheSave = Promise.resolve();
+        let cached = false;
+
         cachedFetch({ url: segmentation_path + 'segmentation.lzma', encoding: null })
         .then((segmentation) => {
-            if (preview) {
-                return scaleVolume(segmentation, intType, task_dim, preview);
-            } else {
-                return segmentation;
-            }
-        })
-        .then((segmentation) => {
-            let dimensions = preview || task_dim;
-            if (preview) {
-                return generateMeshes(segmentation, preview, segments, 1, intType);
-            } else {
-                return generateMeshes(segmentation, task_dim, segments, MIP_COUNT, intType);
-            }
-            
+            const mipCount = preview ? 1 : MIP_COUNT;
+            return loadCachedMeshes(segmentation, task_dim, segments, mipCount, type, fill_holes, preview)
+            .then(({ key, mesher }) => {
+                if (mesher) {
+                    cached = true;
+                    return mesher;
+                }
+
+                // Previews are downsampled inside the mesher and already in full resolution coordinates
+                // Keyed by task, a newer remesh of the same task cancels this one
+                return generateMeshes(segmentation, task_dim, segments, mipCount, intType, fill_holes, preview,
+                                      params.priority === 'high' ? 1 : 0, task_id + 1)
+                .then((mesher) => {
+                    if (mesher && key !== null) {
+                        cacheSave = saveCachedMeshes(mesher, type, key).catch((err) => {
+                            log.error({ event: 'saveCachedMeshes', err: err, task_id: task_id });
+                        });
+                    }
+                    return mesher;
+                });
+            });
         })
         .then((mesher) => {
-            if (preview) { // restore original dimensions for downscaled preview
-                let scale = [task_dim.x / preview.x, task_dim.y / preview.y, task_dim.z / preview.z];
-                return scaleMesh(mesher, intType, scale);
-            } else {
-                return mesher;
+            if (mesher === null) {
+                console.log('cancelled, superseded by a newer remesh', task_id, processId);
+                return fulfill();
             }
-        })
-        .then((mesher) => {
             if (syncMap.get(task_id) !== processId) {
                 console.log('aborted save, not newest mesh', task_id, processId, syncMap.get(task_id));
                  fulfill();
             }
             syncMap.delete(task_id);
 
-            let remaining = MIP_COUNT;
+            const fetches = [];
+            const uploads = [];
             for (let lod = 0; lod < MIP_COUNT; ++lod) {
-                const lengthPtr = ref.alloc(ref.types.size_t);
-                const dataPtr = ref.alloc(CharPtr);
-
-                if (preview) { // Don't want simplified meshes for the preview, those are already low-poly
-                    intType.getSimplifiedMesh(mesher, 0, dataPtr, lengthPtr);//, function (err) { DISABLED ASYNC DUE TO TIMING ISSUE
-                } else {
-                    intType.getSimplifiedMesh(mesher, lod, dataPtr, lengthPtr);//, function (err) { DISABLED ASYNC DUE TO TIMING ISSUE
-                }
-
-                const len = lengthPtr.deref();
-                const data = ref.reinterpret(dataPtr.deref(), len);
-                const buf = new Buffer(data.length);
-
-                if (len === 0) {
-                    console.log('0 byte array', lod, this.params);
-                }
-
-                data.copy(buf, 0, 0, data.length); // Without this nonsense I get { [Error: EFAULT: bad address in system call argument, write] errno: -14, code: 'EFAULT', syscall: 'write' }
+                // Don't want simplified meshes for the preview, those are already low-poly
+                const fetch = getMesh(mesher, intType, preview ? 0 : lod);
+                fetches.push(fetch);
+                uploads.push(fetch.then((buf) => {
+                    if (buf.length === 0) {
+                        console.log('0 byte array', lod, params);
+                    }
 
-                const mipPath = `meshes/${cell_id}/${task_id}/${lod}.dstrip`;
-                const wstream = writeBucket.file(mipPath).createWriteStream({
-                    gzip: true,
-                    metadata: {
-                        cacheControl: 'private, max-age=0, no-transform'
-                    },
-                    resumable: false // small speed boost, is it worth it?
-                });
-                wstream.on('error', function(e) {
-                    console.error(e);
-                    reject(e);
-                });
-                wstream.end(buf);
+                    const mipPath = `meshes/${cell_id}/${task_id}/${lod}.dstrip`;
+                    return new Promise((fulfillUpload, rejectUpload) => {
+                        const wstream = writeBucket.file(mipPath).createWriteStream({
+                            gzip: true,
+                            metadata: {
+                                cacheControl: 'private, max-age=0, no-transform'
+                            },
+                            resumable: false // small speed boost, is it worth it?
+                        });
+                        wstream.on('error', function(e) {
+                            console.error(e);
+                            rejectUpload(e);
+                        });
+                        wstream.on('finish', fulfillUpload);
+                        wstream.end(buf);
+                    });
+                }));
+            }
 
-                wstream.on('finish', () => {
-                    remaining--;
-                    if (remaining === 0) {
-                        fulfill(); 
-                    }
+            // Every LOD is copied out by getMesh, so the mesher can go as soon as all fetches and the
+            // cache write settled
+            Promise.all(fetches.map((fetch) => fetch.reflect()).concat([cacheSave]))
+            .then(() => {
+                log.info({
+                    event: 'meshStats',
+                    task_id: task_id,
+                    preview: !!preview,
+                    cached: cached,
+                    duration: Date.now() - start,
+                    stats: getStats(mesher, intType)
                 });
-            }
+                intType.release(mesher);
+            });
 
-            intType.release(mesher);
+            return Promise.all(uploads.map((upload) => upload.reflect()))
+            .then((results) => {
+                const failed = results.find((result) => result.isRejected());
+                if (failed) reject(failed.reason());
+                else fulfill();
+            });
         }).catch((err) => {
             log.error({
                 event: 'generateMeshes',
@@ -329,6 +572,23 @@ function processRemesh(params) {
 }
 
 const MAX_PROCESSING_COUNT = Math.max(process.env.THREADS || 4, 2);
+
+// Meshing runs on the engine's own workers, independent of the libuv threadpool
+// (UV_THREADPOOL_SIZE). Jobs report back through jobDone on the event loop.
+const TASKMESHER_JOB_DONE = 2;
+const TASKMESHER_JOB_CANCELLED = 3;
+const pendingJobs = new Map();
+const jobDone = ffi.Callback('void', [ 'pointer', 'uint64', 'uint8' ], function (userData, job, status) {
+    const pending = pendingJobs.get(job);
+    if (!pending) return;
+    pendingJobs.delete(job);
+
+    const mesher = TaskMesherLib.TaskMesher_TakeJob(meshEngine, job);
+    if (status === TASKMESHER_JOB_DONE) pending.fulfill(mesher);
+    else if (status === TASKMESHER_JOB_CANCELLED) pending.fulfill(null);
+    else pending.reject(new Error('Mesher job ' + job + ' failed'));
+});
+const meshEngine = TaskMesherLib.TaskMesher_CreateEngine(MAX_PROCESSING_COUNT, jobDone, null);
 let currentProcessingCount = 0;
 const remeshQueuePriorities = {
     high: [],
@@ -414,6 +674,7 @@ app.post('/remesh', null, {
             rule: { min: 0 }
         },
         priority: ['high', 'low'],
+        fill_holes: { type: 'boolean', required: false },
         preview: {
             required: false,
             type: 'object',
@@ -442,6 +703,7 @@ app.post('/remesh', null, {
                 bucket: this.params.bucket,
                 path: this.params.path,
                 segments: this.params.segments,
+                fill_holes: this.params.fill_holes,
                 priority: "low"
             }
             remeshQueuePriorities["low"].push(highres);
@@ -4,8 +4,8 @@ ZILIBDIR="./third_party/zi_lib"
 
 CXXINCLUDES="-I/usr/include -I./include -I$ZILIBDIR"
 CXXLIBS="-L./lib -L/usr/lib/x86_64-linux-gnu"
-COMMON_FLAGS="-fPIC -g -std=c++11"
-OPTIMIZATION_FLAGS="-DNDEBUG -O3"
+COMMON_FLAGS="-fPIC -g -std=c++11 -pthread"
+OPTIMIZATION_FLAGS="-DNDEBUG -O3 -fno-math-errno"
 
 mkdir -p build
 mkdir -p lib
@@ -13,6 +13,26 @@ mkdir -p lib
 echo "Compiling RTM"
 $GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/MeshIO.cpp -o build/MeshIO.o
 $GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/TaskMesher.cpp -o build/TaskMesher.o
+$GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/SegmentMask.cpp -o build/SegmentMask.o
+$GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/MappedVolume.cpp -o build/MappedVolume.o
+$GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/MesherEngine.cpp -o build/MesherEngine.o
+$GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/MeshCache.cpp -o build/MeshCache.o
+$GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/CompressedSegmentation.cpp -o build/CompressedSegmentation.o
+$GCC -c $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS src/MeshArena.cpp -o build/MeshArena.o
 
 echo "Creating librtm.so"
-$GCC $CXXLIBS -shared -fPIC -o lib/librtm.so build/MeshIO.o build/TaskMesher.o
+$GCC $CXXLIBS -shared -fPIC -pthread -o lib/librtm.so build/MeshIO.o build/TaskMesher.o build/SegmentMask.o build/MappedVolume.o build/MesherEngine.o build/MeshCache.o build/CompressedSegmentation.o build/MeshArena.o
+
+if [ "$1" == "bench" ]; then
+  echo "Compiling bench_taskmesher"
+  mkdir -p bin
+  $GCC $CXXINCLUDES $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS bench/bench_taskmesher.cpp -o bin/bench_taskmesher -lrtm -Wl,-rpath,'$ORIGIN/../lib'
+fi
+
+if [ "$1" == "test" ]; then
+  echo "Compiling test_taskmesher"
+  mkdir -p bin
+  $GCC $CXXINCLUDES -I./bench $CXXLIBS $COMMON_FLAGS $OPTIMIZATION_FLAGS test/test_taskmesher.cpp -o bin/test_taskmesher -lrtm -Wl,-rpath,'$ORIGIN/../lib'
+  echo "Running test_taskmesher"
+  bin/test_taskmesher || exit 1
+fi
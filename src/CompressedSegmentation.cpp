@@ -0,0 +1,198 @@
+#include "CompressedSegmentation.h"
+
+#include <cstring>
+#include <map>
+
+/*****************************************************************/
+
+CCompressedSegmentation::CCompressedSegmentation() :
+data_(NULL), words_(0), dim_(0, 0, 0), blockSize_(1, 1, 1), grid_(0, 0, 0), blockVoxels_(1), labelWords_(1)
+{
+}
+
+CCompressedSegmentation::CCompressedSegmentation(const uint32_t * data, size_t words, const zi::vl::vec<size_t, 3> & dim,
+                                                 const zi::vl::vec<size_t, 3> & blockSize, uint8_t labelWords) :
+data_(data), words_(words), dim_(dim), blockSize_(blockSize), blockVoxels_(blockSize[0] * blockSize[1] * blockSize[2]), labelWords_(labelWords)
+{
+  for (int i = 0; i < 3; ++i) {
+    grid_[i] = blockSize[i] > 0 ? (dim[i] + blockSize[i] - 1) / blockSize[i] : 0;
+  }
+  if (data_ && words_ > 0 && data_[0] > 0 && data_[0] < words_) {
+    measureTables();
+  }
+}
+
+// Table lengths are not stored. A table ends where the next table or index
+// array starts, or at the end of the data, and no block uses more entries
+// than it has voxels or indices.
+void CCompressedSegmentation::measureTables()
+{
+  const size_t blocks = grid_[0] * grid_[1] * grid_[2];
+  const size_t available = channelWords();
+  if (blocks > available / 2) {
+    return;
+  }
+
+  const uint32_t * header = channel();
+  std::vector<size_t> starts(2 * blocks + 1, available);
+  for (size_t block = 0; block < blocks; ++block) {
+    starts[2 * block] = header[2 * block] & 0xFFFFFF;
+    starts[2 * block + 1] = header[2 * block + 1];
+  }
+  std::sort(starts.begin(), starts.end());
+
+  tableLengths_.assign(blocks, 0);
+  for (size_t block = 0; block < blocks; ++block) {
+    const size_t offset = header[2 * block] & 0xFFFFFF;
+    const unsigned bits = header[2 * block] >> 24;
+    const auto end = std::upper_bound(starts.begin(), starts.end(), offset);
+    if (end == starts.end()) { // Past the data, valid() fails
+      continue;
+    }
+    size_t length = std::min(blockVoxels_, (*end - offset) / labelWords_);
+    if (bits < 32) {
+      length = std::min(length, size_t(1) << bits);
+    }
+    tableLengths_[block] = uint32_t(length);
+  }
+}
+
+/*****************************************************************/
+
+bool CCompressedSegmentation::valid() const
+{
+  if (!data_ || words_ == 0 || blockVoxels_ == 0 || (labelWords_ != 1 && labelWords_ != 2) || data_[0] == 0 || data_[0] >= words_) {
+    return false;
+  }
+
+  const size_t blocks = grid_[0] * grid_[1] * grid_[2];
+  const size_t available = channelWords();
+  if (blocks > available / 2 || tableLengths_.size() != blocks) {
+    return false;
+  }
+
+  const uint32_t * header = channel();
+  for (size_t block = 0; block < blocks; ++block, header += 2) {
+    const size_t offset = header[0] & 0xFFFFFF;
+    const unsigned bits = header[0] >> 24;
+    if (bits > 32 || (bits & (bits - 1)) != 0) { // 0 or a power of two
+      return false;
+    }
+    if (offset > available || tableLengths_[block] == 0) { // At least one entry
+      return false;
+    }
+    const size_t indexWords = (blockVoxels_ * bits + 31) / 32;
+    if (header[1] > available || available - header[1] < indexWords) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*****************************************************************/
+
+void CCompressedSegmentation::decode(size_t block, const std::vector<uint8_t> & table, uint8_t * out) const
+{
+  const uint32_t * header = channel() + 2 * block;
+  const unsigned bits = header[0] >> 24;
+  const size_t length = table.size();
+
+  if (bits == 0) {
+    memset(out, length > 0 ? table[0] : 0, blockVoxels_);
+    return;
+  }
+
+  // Indices never straddle words, bits divides 32
+  const uint32_t * indices = channel() + header[1];
+  const uint32_t mask = bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+  const unsigned perWord = 32 / bits;
+  for (size_t i = 0; i < blockVoxels_; i += perWord) {
+    uint32_t word = indices[i / perWord];
+    const size_t end = std::min(blockVoxels_, i + perWord);
+    for (size_t v = i; v < end; ++v, word = bits == 32 ? 0 : word >> bits) {
+      const uint32_t index = word & mask;
+      out[v] = index < length ? table[index] : 0;
+    }
+  }
+}
+
+/*****************************************************************/
+
+template<typename T>
+std::vector<uint32_t> CompressSegmentation(const T * volume, const zi::vl::vec<size_t, 3> & dim, const zi::vl::vec<size_t, 3> & blockSize)
+{
+  const CCompressedSegmentation layout(NULL, 0, dim, blockSize);
+  const zi::vl::vec<size_t, 3> & grid = layout.grid();
+  const size_t blocks = grid[0] * grid[1] * grid[2];
+
+  // Offsets below are relative to the channel, which starts at word 1
+  std::vector<uint32_t> out(1 + 2 * blocks, 0);
+  out[0] = 1;
+
+  std::map<std::vector<uint32_t>, uint32_t> tables;
+  std::vector<uint32_t> labels(layout.blockVoxels()), table;
+  size_t block = 0;
+  for (size_t bz = 0; bz < grid[2]; ++bz) {
+    for (size_t by = 0; by < grid[1]; ++by) {
+      for (size_t bx = 0; bx < grid[0]; ++bx, ++block) {
+        const size_t x0 = bx * blockSize[0], y0 = by * blockSize[1], z0 = bz * blockSize[2];
+
+        // Padding repeats the first label, so it adds no table entries
+        const uint32_t padding = volume[x0 + dim[0] * (y0 + dim[1] * z0)];
+        size_t v = 0;
+        for (size_t z = z0; z < z0 + blockSize[2]; ++z) {
+          for (size_t y = y0; y < y0 + blockSize[1]; ++y) {
+            for (size_t x = x0; x < x0 + blockSize[0]; ++x, ++v) {
+              labels[v] = x < dim[0] && y < dim[1] && z < dim[2] ? uint32_t(volume[x + dim[0] * (y + dim[1] * z)]) : padding;
+            }
+          }
+        }
+
+        table = labels;
+        std::sort(table.begin(), table.end());
+        table.erase(std::unique(table.begin(), table.end()), table.end());
+
+        unsigned bits = 0;
+        while ((uint64_t(1) << bits) < table.size()) {
+          bits = bits == 0 ? 1 : 2 * bits;
+        }
+
+        const size_t indexOffset = out.size() - 1;
+        if (bits > 0) {
+          const unsigned perWord = 32 / bits;
+          out.resize(out.size() + (labels.size() + perWord - 1) / perWord, 0);
+          uint32_t * indices = &out[1 + indexOffset];
+          uint32_t last = 0, index = 0;
+          for (size_t i = 0; i < labels.size(); ++i) {
+            if (i == 0 || labels[i] != last) {
+              last = labels[i];
+              index = uint32_t(std::lower_bound(table.begin(), table.end(), last) - table.begin());
+            }
+            indices[i / perWord] |= index << (bits * (i % perWord));
+          }
+        }
+
+        auto shared = tables.find(table);
+        size_t tableOffset;
+        if (shared != tables.end()) {
+          tableOffset = shared->second;
+        } else {
+          tableOffset = out.size() - 1;
+          if (tableOffset > 0xFFFFFF) {
+            return std::vector<uint32_t>();
+          }
+          out.insert(out.end(), table.begin(), table.end());
+          tables.insert(std::make_pair(table, uint32_t(tableOffset)));
+        }
+
+        out[1 + 2 * block] = uint32_t(tableOffset) | (bits << 24);
+        out[2 + 2 * block] = uint32_t(indexOffset);
+      }
+    }
+  }
+  return out;
+}
+
+template std::vector<uint32_t> CompressSegmentation<uint8_t>(const uint8_t *, const zi::vl::vec<size_t, 3> &, const zi::vl::vec<size_t, 3> &);
+template std::vector<uint32_t> CompressSegmentation<uint16_t>(const uint16_t *, const zi::vl::vec<size_t, 3> &, const zi::vl::vec<size_t, 3> &);
+template std::vector<uint32_t> CompressSegmentation<uint32_t>(const uint32_t *, const zi::vl::vec<size_t, 3> &, const zi::vl::vec<size_t, 3> &);
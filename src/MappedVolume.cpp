@@ -0,0 +1,51 @@
+#include "MappedVolume.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+CMappedVolume::CMappedVolume(const std::string & path) :
+fd_(-1), data_(NULL), size_(0)
+{
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+    return;
+  }
+
+  void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED) {
+    return;
+  }
+
+  data_ = static_cast<char *>(data);
+  size_ = st.st_size;
+  madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+CMappedVolume::~CMappedVolume()
+{
+  if (data_) {
+    munmap(data_, size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void CMappedVolume::release(size_t begin, size_t end)
+{
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  begin = (begin + page - 1) / page * page;
+  end = std::min(end, size_) / page * page;
+  if (data_ && begin < end) {
+    madvise(data_ + begin, end - begin, MADV_DONTNEED);
+  }
+}
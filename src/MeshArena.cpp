@@ -0,0 +1,75 @@
+#include "MeshArena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+
+/*****************************************************************/
+
+CMeshArena::CMeshArena() :
+cursor_(NULL), left_(0), nextBlock_(MESH_ARENA_FIRST_BLOCK), reserved_(0)
+{
+}
+
+CMeshArena::~CMeshArena()
+{
+  release();
+}
+
+/*****************************************************************/
+
+// Whole pages, page alignment covers MESH_ARENA_ALIGNMENT
+char * CMeshArena::newBlock(size_t bytes)
+{
+  static const size_t pageSize = sysconf(_SC_PAGESIZE);
+  const size_t length = (bytes + pageSize - 1) / pageSize * pageSize;
+
+  void * block = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (block == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  blocks_.push_back(std::make_pair(static_cast<char *>(block), length));
+  reserved_ += length;
+  return static_cast<char *>(block);
+}
+
+char * CMeshArena::allocate(size_t bytes)
+{
+  const size_t aligned = (std::max<size_t>(bytes, 1) + MESH_ARENA_ALIGNMENT - 1) / MESH_ARENA_ALIGNMENT * MESH_ARENA_ALIGNMENT;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (aligned > left_) {
+    if (aligned > nextBlock_ / 2) { // Own block, the current one stays usable
+      return newBlock(aligned);
+    }
+    cursor_ = newBlock(nextBlock_);
+    left_ = nextBlock_;
+    nextBlock_ = std::min(2 * nextBlock_, MESH_ARENA_MAX_BLOCK);
+  }
+
+  char * out = cursor_;
+  cursor_ += aligned;
+  left_ -= aligned;
+  return out;
+}
+
+void CMeshArena::release()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto block = blocks_.begin(); block != blocks_.end(); ++block) {
+    munmap(block->first, block->second);
+  }
+  blocks_.clear();
+  cursor_ = NULL;
+  left_ = 0;
+  nextBlock_ = MESH_ARENA_FIRST_BLOCK;
+  reserved_ = 0;
+}
+
+size_t CMeshArena::reservedBytes()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return reserved_;
+}
@@ -0,0 +1,175 @@
+#include "MeshCache.h"
+#include "MappedVolume.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*****************************************************************/
+
+CMeshBlob::CMeshBlob(const std::string & path) :
+file_(new CMappedVolume(path)), data_(file_->data()), size_(file_->size())
+{
+}
+
+CMeshBlob::CMeshBlob(std::vector<char> data) :
+owned_(std::move(data)), data_(owned_.data()), size_(owned_.size())
+{
+}
+
+CMeshBlob::~CMeshBlob()
+{
+}
+
+/*****************************************************************/
+
+bool CMeshBlob::valid() const
+{
+  if (!data_ || size_ < sizeof(CMeshBlobHeader)) {
+    return false;
+  }
+
+  const CMeshBlobHeader & h = header();
+  if (memcmp(h.magic, MESH_BLOB_MAGIC, sizeof(h.magic)) != 0 || h.version != MESH_BLOB_VERSION || h.totalBytes != size_ ||
+      h.sectionCount > (size_ - sizeof(CMeshBlobHeader)) / sizeof(CMeshBlobSection)) {
+    return false;
+  }
+
+  const CMeshBlobSection * sections = reinterpret_cast<const CMeshBlobSection *>(data_ + sizeof(CMeshBlobHeader));
+  for (uint64_t i = 0; i < h.sectionCount; ++i) {
+    if (sections[i].offset % MESH_BLOB_ALIGNMENT != 0 || sections[i].offset > size_ || sections[i].length > size_ - sections[i].offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char * CMeshBlob::section(size_t index, size_t * length) const
+{
+  const CMeshBlobSection & s = reinterpret_cast<const CMeshBlobSection *>(data_ + sizeof(CMeshBlobHeader))[index];
+  *length = s.length;
+  return s.length > 0 ? data_ + s.offset : NULL;
+}
+
+/*****************************************************************/
+
+CMeshBlobWriter::CMeshBlobWriter(uint64_t key, const uint64_t dim[3], uint32_t labelBytes, uint8_t lodCount, uint8_t formats)
+{
+  memset(&header_, 0, sizeof(header_));
+  memcpy(header_.magic, MESH_BLOB_MAGIC, sizeof(header_.magic));
+  header_.version = MESH_BLOB_VERSION;
+  header_.key = key;
+  header_.dim[0] = dim[0];
+  header_.dim[1] = dim[1];
+  header_.dim[2] = dim[2];
+  header_.labelBytes = labelBytes;
+  header_.lodCount = lodCount;
+  header_.formats = formats;
+}
+
+void CMeshBlobWriter::write(std::vector<char> & blob)
+{
+  const auto align = [](size_t offset) { return (offset + MESH_BLOB_ALIGNMENT - 1) / MESH_BLOB_ALIGNMENT * MESH_BLOB_ALIGNMENT; };
+
+  std::vector<CMeshBlobSection> table(sections_.size());
+  size_t offset = align(sizeof(CMeshBlobHeader) + table.size() * sizeof(CMeshBlobSection));
+  for (size_t i = 0; i < sections_.size(); ++i) {
+    table[i].offset = offset;
+    table[i].length = sections_[i].second;
+    offset = align(offset + sections_[i].second);
+  }
+
+  header_.sectionCount = table.size();
+  header_.totalBytes = offset;
+
+  blob.assign(offset, 0); // Padding included, identical meshes give identical blobs
+  memcpy(blob.data(), &header_, sizeof(header_));
+  if (!table.empty()) {
+    memcpy(blob.data() + sizeof(header_), table.data(), table.size() * sizeof(CMeshBlobSection));
+  }
+  for (size_t i = 0; i < sections_.size(); ++i) {
+    if (sections_[i].second > 0) {
+      memcpy(blob.data() + table[i].offset, sections_[i].first, sections_[i].second);
+    }
+  }
+}
+
+/*****************************************************************/
+
+bool WriteFileAtomic(const std::string & path, const std::vector<char> & data)
+{
+  // mkstemp gives every call its own file, also for threads writing the same key
+  std::string temp = path + ".XXXXXX";
+  const int fd = mkstemp(&temp[0]);
+  if (fd < 0) {
+    return false;
+  }
+  fchmod(fd, 0644); // mkstemp creates it 0600
+
+  bool written = true;
+  for (size_t offset = 0; offset < data.size(); ) {
+    const ssize_t n = write(fd, data.data() + offset, data.size() - offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      written = false;
+      break;
+    }
+    offset += n;
+  }
+
+  if (close(fd) != 0 || !written || std::rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*****************************************************************/
+
+static inline uint64_t HashRound(uint64_t h, uint64_t v)
+{
+  h ^= v * 0x9E3779B97F4A7C15ULL;
+  h = (h << 31) | (h >> 33);
+  return h * 0xC2B2AE3D27D4EB4FULL;
+}
+
+// Four independent lanes over 32 byte strides keep the multipliers busy, a
+// label volume hashes at about memory bandwidth
+uint64_t HashBytes(const void * data, size_t length, uint64_t seed)
+{
+  const char * p = static_cast<const char *>(data);
+  uint64_t lane[4] = { seed ^ 0x243F6A8885A308D3ULL, seed ^ 0x13198A2E03707344ULL,
+                       seed ^ 0xA4093822299F31D0ULL, seed ^ 0x082EFA98EC4E6C89ULL };
+
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    uint64_t v[4];
+    memcpy(v, p + i, sizeof(v));
+    lane[0] = HashRound(lane[0], v[0]);
+    lane[1] = HashRound(lane[1], v[1]);
+    lane[2] = HashRound(lane[2], v[2]);
+    lane[3] = HashRound(lane[3], v[3]);
+  }
+
+  uint64_t h = HashRound(HashRound(HashRound(HashRound(length, lane[0]), lane[1]), lane[2]), lane[3]);
+  for (; i < length; i += 8) {
+    uint64_t v = 0;
+    memcpy(&v, p + i, std::min<size_t>(8, length - i));
+    h = HashRound(h, v);
+  }
+
+  // Final avalanche (murmur3 fmix64)
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
+}
@@ -1,6 +1,11 @@
 #include "MeshIO.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <unordered_map>
 
 bool WriteDegTriStrip(zi::mesh::simplifier<double> &s, const std::string &filename) {
   std::vector<zi::vl::vec3d> points;
@@ -34,22 +39,367 @@ bool WriteDegTriStrip(zi::mesh::simplifier<double> &s, const std::string &filena
   return false;
 }
 
-std::vector<float> CreateDegTriStrip(zi::mesh::simplifier<double> &s) {
-  std::vector<zi::vl::vec3d> points;
-  std::vector<zi::vl::vec3d> normals;
+static void Stripify(zi::mesh::simplifier<double> &s, CVertexArrays & vertices, std::vector<uint32_t> & indices,
+                     std::vector<uint32_t> & strip_begins, std::vector<uint32_t> & strip_lengths,
+                     size_t * vertexCount, const CVertexTransform * transform) {
+  {
+    // Converted right away, the serializers only read floats
+    std::vector<zi::vl::vec3d> points;
+    std::vector<zi::vl::vec3d> normals;
+    s.stripify(points, normals, indices, strip_begins, strip_lengths);
+    ToVertexArrays(vertices, points, normals);
+  }
+  if (transform) {
+    TransformVertexArrays(vertices, *transform);
+  }
+
+  if (vertexCount) {
+    *vertexCount = vertices.position[0].size();
+  }
+}
+
+std::vector<float> CreateDegTriStrip(zi::mesh::simplifier<double> &s, size_t * vertexCount,
+                                     const CVertexTransform * transform) {
   std::vector<uint32_t> indices;
   std::vector<uint32_t> strip_begins;
   std::vector<uint32_t> strip_lengths;
-
-  s.stripify(points, normals, indices, strip_begins, strip_lengths);
+  CVertexArrays vertices;
+  Stripify(s, vertices, indices, strip_begins, strip_lengths, vertexCount, transform);
 
   std::vector<float> degen;
 
-  tri_strip_to_degenerate(degen, points, normals, indices, strip_begins, strip_lengths);
+  tri_strip_to_degenerate(degen, vertices, indices, strip_begins, strip_lengths);
 
   return degen;
 }
 
+char * CreateDegTriStrip(zi::mesh::simplifier<double> &s, CMeshArena & arena, size_t * length,
+                         size_t * vertexCount, const CVertexTransform * transform) {
+  std::vector<uint32_t> indices;
+  std::vector<uint32_t> strip_begins;
+  std::vector<uint32_t> strip_lengths;
+  CVertexArrays vertices;
+  Stripify(s, vertices, indices, strip_begins, strip_lengths, vertexCount, transform);
+
+  *length = 6 * sizeof(float) * DegenerateStripLength(strip_lengths);
+  char * out = arena.allocate(*length);
+  tri_strip_to_degenerate(reinterpret_cast<float *>(out), vertices, indices, strip_begins, strip_lengths);
+  return out;
+}
+
+static inline int8_t ToSnorm8(float v) {
+  return static_cast<int8_t>(std::lround(std::max(-1.0f, std::min(1.0f, v)) * 127.0f));
+}
+
+// Octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1 and
+// fold the lower hemisphere over the diagonals.
+static inline void OctEncode(float x, float y, float z, int8_t * out) {
+  const float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+  if (l1 == 0.0f) {
+    out[0] = out[1] = 0;
+    return;
+  }
+  x /= l1;
+  y /= l1;
+  if (z < 0.0f) {
+    const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = fx;
+    y = fy;
+  }
+  out[0] = ToSnorm8(x);
+  out[1] = ToSnorm8(y);
+}
+
+template<typename Index>
+static void WriteIndices(char * out, const std::vector<uint32_t> & indices) {
+  Index * written = reinterpret_cast<Index *>(out);
+  for (auto i = indices.begin(); i != indices.end(); ++i) {
+    *written++ = static_cast<Index>(*i);
+  }
+}
+
+static inline void OctDecode(const int8_t * in, float & x, float & y, float & z) {
+  x = std::max(-1.0f, in[0] / 127.0f);
+  y = std::max(-1.0f, in[1] / 127.0f);
+  z = 1.0f - std::abs(x) - std::abs(y);
+  if (z < 0.0f) {
+    const float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    const float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = fx;
+    y = fy;
+  }
+  const float length = std::sqrt(x * x + y * y + z * z);
+  x /= length;
+  y /= length;
+  z /= length;
+}
+
+// Quantizes `vertices` into the header's grid and the buffers behind it,
+// header.vertexCount must already be set
+static void WriteIndexedVertices(CIndexedMeshHeader & header, const CVertexArrays & vertices,
+                                 uint16_t * positions, int8_t * octNormals) {
+  const size_t count = header.vertexCount;
+
+  // Quantization grid spans the bounding box of this mesh
+  float lo[3] = { 0.0f, 0.0f, 0.0f };
+  float hi[3] = { 0.0f, 0.0f, 0.0f };
+  if (count > 0) {
+    for (int i = 0; i < 3; ++i) {
+      const std::vector<float> & p = vertices.position[i];
+      lo[i] = *std::min_element(p.begin(), p.end());
+      hi[i] = *std::max_element(p.begin(), p.end());
+    }
+  }
+
+  float invScale[3];
+  for (int i = 0; i < 3; ++i) {
+    const float range = hi[i] - lo[i];
+    header.origin[i] = lo[i];
+    header.scale[i] = range > 0.0f ? range / 65535.0f : 1.0f;
+    invScale[i] = range > 0.0f ? 65535.0f / range : 0.0f;
+  }
+
+  for (int i = 0; i < 3; ++i) {
+    const float * p = vertices.position[i].data();
+    for (size_t v = 0; v < count; ++v) {
+      positions[3 * v + i] = static_cast<uint16_t>((p[v] - lo[i]) * invScale[i] + 0.5f);
+    }
+  }
+
+  for (size_t v = 0; v < count; ++v) {
+    OctEncode(vertices.normal[0][v], vertices.normal[1][v], vertices.normal[2][v], &octNormals[2 * v]);
+  }
+}
+
+// Merges vertices with the same quantized position and normal (48 + 16 bits,
+// one key) into their first occurrence and drops the triangles that lose an
+// edge to it
+static void WeldQuantized(const uint16_t * positions, const int8_t * octNormals, size_t count, std::vector<uint32_t> & indices) {
+  std::unordered_map<uint64_t, uint32_t> first(count);
+  std::vector<uint32_t> weld(count);
+  for (size_t v = 0; v < count; ++v) {
+    const uint64_t key = uint64_t(positions[3 * v]) | (uint64_t(positions[3 * v + 1]) << 16) | (uint64_t(positions[3 * v + 2]) << 32) |
+                         (uint64_t(uint8_t(octNormals[2 * v])) << 48) | (uint64_t(uint8_t(octNormals[2 * v + 1])) << 56);
+    weld[v] = first.emplace(key, static_cast<uint32_t>(v)).first->second;
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    const uint32_t a = weld[indices[i]], b = weld[indices[i + 1]], c = weld[indices[i + 2]];
+    if (a == b || b == c || a == c) continue;
+    indices[kept++] = a;
+    indices[kept++] = b;
+    indices[kept++] = c;
+  }
+  indices.resize(kept);
+}
+
+// `allocate(bytes)` provides the output buffer once its size is known
+template<typename Allocate>
+static char * WriteIndexedMesh(zi::mesh::simplifier<double> &s, size_t * vertexCount, const CVertexTransform * transform,
+                               double * acmr, size_t & length, Allocate allocate) {
+  std::vector<uint32_t> indices;
+  CVertexArrays vertices;
+
+  {
+    std::vector<zi::vl::vec3d> points;
+    std::vector<zi::vl::vec3d> normals;
+    std::vector<vec3u> faces;
+    s.get_faces(points, normals, faces);
+    ToVertexArrays(vertices, points, normals);
+
+    indices.reserve(3 * faces.size());
+    for (auto f = faces.begin(); f != faces.end(); ++f) {
+      indices.push_back((*f)[0]);
+      indices.push_back((*f)[2]);
+      indices.push_back((*f)[1]);
+    }
+  }
+  if (transform) {
+    TransformVertexArrays(vertices, *transform);
+  }
+  const size_t count = vertices.position[0].size();
+
+  // Quantized first, welding compares what ends up in the buffer
+  CIndexedMeshHeader header;
+  memcpy(header.magic, "RTMI", 4);
+  header.version = INDEXED_MESH_VERSION;
+  header.vertexCount = static_cast<uint32_t>(count);
+  std::vector<uint16_t> positions(3 * count);
+  std::vector<int8_t> octNormals(2 * count);
+  WriteIndexedVertices(header, vertices, positions.data(), octNormals.data());
+
+  WeldQuantized(positions.data(), octNormals.data(), count, indices);
+  OptimizeVertexCache(indices, count);
+  std::vector<uint32_t> remap;
+  const size_t used = OptimizeVertexFetch(indices, count, remap);
+
+  if (vertexCount) {
+    *vertexCount = used;
+  }
+  if (acmr) {
+    *acmr = AverageCacheMissRatio(indices, used);
+  }
+
+  header.vertexCount = static_cast<uint32_t>(used);
+  header.indexCount = static_cast<uint32_t>(indices.size());
+  header.indexSize = used <= 65536 ? 2 : 4;
+
+  const size_t positionBytes = 6 * used;
+  const size_t normalBytes = 2 * used;
+  length = sizeof(header) + positionBytes + normalBytes + header.indexSize * header.indexCount;
+  char * out = allocate(length);
+  memcpy(out, &header, sizeof(header));
+
+  uint16_t * outPositions = reinterpret_cast<uint16_t *>(&out[sizeof(header)]);
+  int8_t * outNormals = reinterpret_cast<int8_t *>(&out[sizeof(header) + positionBytes]);
+  for (size_t v = 0; v < count; ++v) {
+    if (remap[v] == std::numeric_limits<uint32_t>::max()) continue;
+    memcpy(&outPositions[3 * remap[v]], &positions[3 * v], 3 * sizeof(uint16_t));
+    memcpy(&outNormals[2 * remap[v]], &octNormals[2 * v], 2 * sizeof(int8_t));
+  }
+
+  char * outIndices = &out[sizeof(header) + positionBytes + normalBytes];
+  if (header.indexSize == 2) {
+    WriteIndices<uint16_t>(outIndices, indices);
+  } else {
+    WriteIndices<uint32_t>(outIndices, indices);
+  }
+
+  return out;
+}
+
+std::vector<char> CreateIndexedMesh(zi::mesh::simplifier<double> &s, size_t * vertexCount,
+                                    const CVertexTransform * transform, double * acmr) {
+  std::vector<char> out;
+  size_t length;
+  WriteIndexedMesh(s, vertexCount, transform, acmr, length, [&out](size_t bytes) {
+    out.resize(bytes);
+    return out.data();
+  });
+  return out;
+}
+
+char * CreateIndexedMesh(zi::mesh::simplifier<double> &s, CMeshArena & arena, size_t * length, size_t * vertexCount,
+                         const CVertexTransform * transform, double * acmr) {
+  return WriteIndexedMesh(s, vertexCount, transform, acmr, *length, [&arena](size_t bytes) { return arena.allocate(bytes); });
+}
+
+/*****************************************************************/
+
+// Tipsify: fans around one vertex at a time, emitting all its remaining
+// triangles, then continues with the vertex of the last fan that is still
+// in the cache and whose triangles would not push it out, falling back to
+// recently used (dead end stack) and then to the next unfinished vertex.
+void OptimizeVertexCache(std::vector<uint32_t> & indices, size_t vertexCount, size_t cacheSize) {
+  const size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Remaining triangles of every vertex and their list (CSR)
+  std::vector<uint32_t> live(vertexCount, 0);
+  for (size_t i = 0; i < 3 * triangleCount; ++i) {
+    ++live[indices[i]];
+  }
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v) {
+    offsets[v + 1] = offsets[v] + live[v];
+  }
+  std::vector<uint32_t> adjacency(3 * triangleCount);
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < 3 * triangleCount; ++i) {
+      adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> ordered;
+  ordered.reserve(3 * triangleCount);
+  uint32_t time = static_cast<uint32_t>(cacheSize) + 1;
+  size_t cursor = 0;
+
+  auto skipDeadEnd = [&]() -> size_t {
+    while (!deadEnd.empty()) {
+      const uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (live[v] > 0) return v;
+    }
+    for (; cursor < vertexCount; ++cursor) {
+      if (live[cursor] > 0) return cursor;
+    }
+    return SIZE_MAX;
+  };
+
+  for (size_t fan = skipDeadEnd(); fan != SIZE_MAX; ) {
+    candidates.clear();
+    for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+      const uint32_t t = adjacency[a];
+      if (emitted[t]) continue;
+      emitted[t] = 1;
+      for (int k = 0; k < 3; ++k) {
+        const uint32_t v = indices[3 * t + k];
+        ordered.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    size_t next = SIZE_MAX;
+    int64_t best = -1;
+    for (auto v = candidates.begin(); v != candidates.end(); ++v) {
+      if (live[*v] == 0) continue;
+      const int64_t age = time - cacheTime[*v];
+      const int64_t priority = age + 2 * int64_t(live[*v]) <= int64_t(cacheSize) ? age : 0;
+      if (priority > best) {
+        best = priority;
+        next = *v;
+      }
+    }
+    fan = next != SIZE_MAX ? next : skipDeadEnd();
+  }
+
+  indices.swap(ordered);
+}
+
+size_t OptimizeVertexFetch(std::vector<uint32_t> & indices, size_t vertexCount, std::vector<uint32_t> & remap) {
+  remap.assign(vertexCount, std::numeric_limits<uint32_t>::max());
+  uint32_t used = 0;
+  for (auto i = indices.begin(); i != indices.end(); ++i) {
+    if (remap[*i] == std::numeric_limits<uint32_t>::max()) {
+      remap[*i] = used++;
+    }
+    *i = remap[*i];
+  }
+  return used;
+}
+
+double AverageCacheMissRatio(const std::vector<uint32_t> & indices, size_t vertexCount, size_t cacheSize) {
+  if (indices.size() < 3) {
+    return 0.0;
+  }
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = static_cast<uint32_t>(cacheSize) + 1;
+  size_t misses = 0;
+  for (auto i = indices.begin(); i != indices.end(); ++i) {
+    if (time - cacheTime[*i] > cacheSize) {
+      cacheTime[*i] = time++;
+      ++misses;
+    }
+  }
+  return double(misses) / double(indices.size() / 3);
+}
+
 bool WriteTriMesh(zi::mesh::simplifier<double> & s, const std::string & filename) {
   std::vector<zi::vl::vec3d> points;
   std::vector<zi::vl::vec3d> normals;
@@ -129,57 +479,272 @@ bool WriteObj(zi::mesh::simplifier<double> & s, const std::string & filename) {
   return false;
 }
 
-void tri_strip_to_degenerate(std::vector<float> &newpoints,
-                             const std::vector<zi::vl::vec3d> &points,
-                             const std::vector<zi::vl::vec3d> &normals,
+void ToVertexArrays(CVertexArrays & out,
+                    const std::vector<zi::vl::vec3d> & points,
+                    const std::vector<zi::vl::vec3d> & normals) {
+  const size_t n = points.size();
+  for (int i = 0; i < 3; ++i) {
+    out.position[i].resize(n);
+    out.normal[i].resize(n);
+  }
+
+  float * __restrict px = out.position[0].data();
+  float * __restrict py = out.position[1].data();
+  float * __restrict pz = out.position[2].data();
+  float * __restrict nx = out.normal[0].data();
+  float * __restrict ny = out.normal[1].data();
+  float * __restrict nz = out.normal[2].data();
+  const zi::vl::vec3d * p = points.data();
+  const zi::vl::vec3d * nrm = normals.data();
+
+  // Simplifier order is z, y, x
+  for (size_t v = 0; v < n; ++v) {
+    px[v] = static_cast<float>(p[v][2]);
+    py[v] = static_cast<float>(p[v][1]);
+    pz[v] = static_cast<float>(p[v][0]);
+  }
+  for (size_t v = 0; v < n; ++v) {
+    nx[v] = static_cast<float>(nrm[v][2]);
+    ny[v] = static_cast<float>(nrm[v][1]);
+    nz[v] = static_cast<float>(nrm[v][0]);
+  }
+}
+
+/*****************************************************************/
+
+CVertexTransform::CVertexTransform() {
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      linear[r][c] = r == c ? 1.0f : 0.0f;
+    }
+    offset[r] = 0.0f;
+  }
+}
+
+CVertexTransform::CVertexTransform(const float affine[12]) {
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      linear[r][c] = affine[4 * r + c];
+    }
+    offset[r] = affine[4 * r + 3];
+  }
+}
+
+CVertexTransform CVertexTransform::Scale(const float scale[3]) {
+  CVertexTransform transform;
+  for (int i = 0; i < 3; ++i) {
+    transform.linear[i][i] = scale[i];
+  }
+  return transform;
+}
+
+bool CVertexTransform::isIdentity() const {
+  const CVertexTransform identity;
+  return memcmp(this, &identity, sizeof(identity)) == 0;
+}
+
+// Inverse transpose of `linear` up to a positive factor (normals are
+// renormalized anyway): the cofactor matrix, negated for mirroring maps.
+static void NormalMatrix(const CVertexTransform & transform, float normal[3][3]) {
+  const float (*m)[3] = transform.linear;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      const int r1 = (r + 1) % 3, r2 = (r + 2) % 3;
+      const int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+      normal[r][c] = m[r1][c1] * m[r2][c2] - m[r1][c2] * m[r2][c1];
+    }
+  }
+
+  const float det = m[0][0] * normal[0][0] + m[0][1] * normal[0][1] + m[0][2] * normal[0][2];
+  if (det < 0.0f) {
+    for (int r = 0; r < 3; ++r) {
+      for (int c = 0; c < 3; ++c) {
+        normal[r][c] = -normal[r][c];
+      }
+    }
+  }
+}
+
+// Branch free so the loops below vectorize (sqrt needs -fno-math-errno, see
+// make.sh), FLT_MIN keeps zero normals at zero
+static inline void MapVertex(const CVertexTransform & transform, const float normal[3][3],
+                             float & px, float & py, float & pz, float & nx, float & ny, float & nz) {
+  const float (*m)[3] = transform.linear;
+  const float x = px, y = py, z = pz;
+  px = m[0][0] * x + m[0][1] * y + m[0][2] * z + transform.offset[0];
+  py = m[1][0] * x + m[1][1] * y + m[1][2] * z + transform.offset[1];
+  pz = m[2][0] * x + m[2][1] * y + m[2][2] * z + transform.offset[2];
+
+  const float a = normal[0][0] * nx + normal[0][1] * ny + normal[0][2] * nz;
+  const float b = normal[1][0] * nx + normal[1][1] * ny + normal[1][2] * nz;
+  const float c = normal[2][0] * nx + normal[2][1] * ny + normal[2][2] * nz;
+  const float invLength = 1.0f / std::sqrt(a * a + b * b + c * c + std::numeric_limits<float>::min());
+  nx = a * invLength;
+  ny = b * invLength;
+  nz = c * invLength;
+}
+
+// Out of line, the __restrict qualifiers don't survive inlining
+__attribute__((noinline))
+static void MapVertexArrays(const CVertexTransform & transform, const float normal[3][3], size_t n,
+                            float * __restrict px, float * __restrict py, float * __restrict pz,
+                            float * __restrict nx, float * __restrict ny, float * __restrict nz) {
+  // Local copies, so the loop doesn't have to assume the outputs alias them
+  const CVertexTransform map = transform;
+  float normalMap[3][3];
+  memcpy(normalMap, normal, sizeof(normalMap));
+
+  for (size_t v = 0; v < n; ++v) {
+    MapVertex(map, normalMap, px[v], py[v], pz[v], nx[v], ny[v], nz[v]);
+  }
+}
+
+void TransformVertexArrays(CVertexArrays & vertices, const CVertexTransform & transform) {
+  if (transform.isIdentity()) {
+    return;
+  }
+
+  float normal[3][3];
+  NormalMatrix(transform, normal);
+
+  MapVertexArrays(transform, normal, vertices.position[0].size(),
+                  vertices.position[0].data(), vertices.position[1].data(), vertices.position[2].data(),
+                  vertices.normal[0].data(), vertices.normal[1].data(), vertices.normal[2].data());
+}
+
+void TransformDegTriStrip(float * data, size_t vertexCount, const CVertexTransform & transform) {
+  if (transform.isIdentity()) {
+    return;
+  }
+
+  // Local copies, so the loop doesn't have to assume the output aliases them
+  const CVertexTransform map = transform;
+  float normal[3][3];
+  NormalMatrix(map, normal);
+
+  float * __restrict v = data;
+  for (size_t i = 0; i < vertexCount; ++i, v += 6) {
+    MapVertex(map, normal, v[0], v[1], v[2], v[3], v[4], v[5]);
+  }
+}
+
+void TransformIndexedMesh(char * data, const CVertexTransform & transform) {
+  if (transform.isIdentity()) {
+    return;
+  }
+
+  CIndexedMeshHeader header;
+  memcpy(&header, data, sizeof(header));
+  const size_t count = header.vertexCount;
+  uint16_t * positions = reinterpret_cast<uint16_t *>(data + sizeof(header));
+  int8_t * octNormals = reinterpret_cast<int8_t *>(data + sizeof(header) + 6 * count);
+
+  // Diagonal maps move the quantization grid instead of the vertices, which
+  // is exact however often it is applied. Normals are only re-encoded if the
+  // map changes their direction (unequal or mirroring scales).
+  const float (*m)[3] = transform.linear;
+  if (m[0][1] == 0.0f && m[0][2] == 0.0f && m[1][0] == 0.0f && m[1][2] == 0.0f && m[2][0] == 0.0f && m[2][1] == 0.0f) {
+    for (int i = 0; i < 3; ++i) {
+      header.origin[i] = m[i][i] * header.origin[i] + transform.offset[i];
+      header.scale[i] *= m[i][i];
+    }
+    memcpy(data, &header, sizeof(header));
+
+    if (m[0][0] != m[1][1] || m[1][1] != m[2][2] || m[0][0] <= 0.0f) {
+      float normal[3][3];
+      NormalMatrix(transform, normal);
+      for (size_t v = 0; v < count; ++v) {
+        float px = 0.0f, py = 0.0f, pz = 0.0f, nx, ny, nz;
+        OctDecode(&octNormals[2 * v], nx, ny, nz);
+        MapVertex(transform, normal, px, py, pz, nx, ny, nz);
+        OctEncode(nx, ny, nz, &octNormals[2 * v]);
+      }
+    }
+    return;
+  }
+
+  CVertexArrays vertices;
+  for (int i = 0; i < 3; ++i) {
+    vertices.position[i].resize(count);
+    vertices.normal[i].resize(count);
+    for (size_t v = 0; v < count; ++v) {
+      vertices.position[i][v] = header.origin[i] + positions[3 * v + i] * header.scale[i];
+    }
+  }
+  for (size_t v = 0; v < count; ++v) {
+    OctDecode(&octNormals[2 * v], vertices.normal[0][v], vertices.normal[1][v], vertices.normal[2][v]);
+  }
+
+  TransformVertexArrays(vertices, transform);
+  WriteIndexedVertices(header, vertices, positions, octNormals);
+  memcpy(data, &header, sizeof(header));
+}
+
+/*****************************************************************/
+
+static inline float * EmitVertex(float * out, const CVertexArrays & vertices, size_t idx) {
+  out[0] = vertices.position[0][idx];
+  out[1] = vertices.position[1][idx];
+  out[2] = vertices.position[2][idx];
+  out[3] = vertices.normal[0][idx];
+  out[4] = vertices.normal[1][idx];
+  out[5] = vertices.normal[2][idx];
+  return out + 6;
+}
+
+size_t DegenerateStripLength(const std::vector<uint32_t> &lengths) {
+  size_t count = 0;
+  for (std::size_t i = 0; i < lengths.size(); ++i) {
+    if (i > 0) {
+      count += count % 2 == 1 ? 3 : 2;
+    }
+    count += lengths[i];
+  }
+  return count;
+}
+
+void tri_strip_to_degenerate(float *out,
+                             const CVertexArrays &vertices,
                              const std::vector<uint32_t> &indices,
                              const std::vector<uint32_t> &starts,
                              const std::vector<uint32_t> &lengths) {
-
-  newpoints.clear();
+  float * const begin = out;
 
   for (std::size_t i = 0; i < starts.size(); ++i) {
     if (i > 0) {
       // add the last point
-      {
-        std::size_t idx = indices[starts[i - 1] + lengths[i - 1] - 1];
-        newpoints.push_back(static_cast<float>(points[idx].at(2)));
-        newpoints.push_back(static_cast<float>(points[idx].at(1)));
-        newpoints.push_back(static_cast<float>(points[idx].at(0)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(2)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(1)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(0)));
-      }
+      out = EmitVertex(out, vertices, indices[starts[i - 1] + lengths[i - 1] - 1]);
 
-      if ((newpoints.size() / 6) % 2 == 0) {
-        std::size_t idx = indices[starts[i]];
-        newpoints.push_back(static_cast<float>(points[idx].at(2)));
-        newpoints.push_back(static_cast<float>(points[idx].at(1)));
-        newpoints.push_back(static_cast<float>(points[idx].at(0)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(2)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(1)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(0)));
+      if ((out - begin) / 6 % 2 == 0) {
+        out = EmitVertex(out, vertices, indices[starts[i]]);
       }
 
-      {
-        std::size_t idx = indices[starts[i]];
-        newpoints.push_back(static_cast<float>(points[idx].at(2)));
-        newpoints.push_back(static_cast<float>(points[idx].at(1)));
-        newpoints.push_back(static_cast<float>(points[idx].at(0)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(2)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(1)));
-        newpoints.push_back(static_cast<float>(normals[idx].at(0)));
-      }
+      out = EmitVertex(out, vertices, indices[starts[i]]);
     }
 
     for (uint32_t j = starts[i]; j < starts[i] + lengths[i]; ++j) {
-      std::size_t idx = indices[j];
-      newpoints.push_back(static_cast<float>(points[idx].at(2)));
-      newpoints.push_back(static_cast<float>(points[idx].at(1)));
-      newpoints.push_back(static_cast<float>(points[idx].at(0)));
-      newpoints.push_back(static_cast<float>(normals[idx].at(2)));
-      newpoints.push_back(static_cast<float>(normals[idx].at(1)));
-      newpoints.push_back(static_cast<float>(normals[idx].at(0)));
+      out = EmitVertex(out, vertices, indices[j]);
     }
   }
 }
+
+void tri_strip_to_degenerate(std::vector<float> &newpoints,
+                             const CVertexArrays &vertices,
+                             const std::vector<uint32_t> &indices,
+                             const std::vector<uint32_t> &starts,
+                             const std::vector<uint32_t> &lengths) {
+  // Counted first, so the strip is written in place instead of grown vertex by vertex
+  newpoints.resize(6 * DegenerateStripLength(lengths));
+  tri_strip_to_degenerate(newpoints.data(), vertices, indices, starts, lengths);
+}
+
+void tri_strip_to_degenerate(std::vector<float> &newpoints,
+                             const std::vector<zi::vl::vec3d> &points,
+                             const std::vector<zi::vl::vec3d> &normals,
+                             const std::vector<uint32_t> &indices,
+                             const std::vector<uint32_t> &starts,
+                             const std::vector<uint32_t> &lengths) {
+  CVertexArrays vertices;
+  ToVertexArrays(vertices, points, normals);
+  tri_strip_to_degenerate(newpoints, vertices, indices, starts, lengths);
+}
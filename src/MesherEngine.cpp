@@ -0,0 +1,208 @@
+#include "MesherEngine.h"
+
+#include <algorithm>
+
+/*****************************************************************/
+
+CMesherEngine::CMesherEngine(size_t threadCount, const Callback & done) :
+done_(done), nextJob_(1), stopping_(false)
+{
+  if (threadCount == 0) {
+    threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threadCount; ++i) {
+    workers_.emplace_back(&CMesherEngine::run, this);
+  }
+}
+
+/*****************************************************************/
+
+CMesherEngine::~CMesherEngine()
+{
+  std::vector<uint64_t> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    while (!queue_.empty()) {
+      cancelLocked(queue_.begin()->second, dropped);
+    }
+  }
+  notify(dropped);
+
+  wake_.notify_all();
+  for (auto & worker : workers_) {
+    worker.join();
+  }
+
+  for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+    if (it->second.result) {
+      it->second.release(it->second.result);
+    }
+  }
+}
+
+/*****************************************************************/
+
+uint64_t CMesherEngine::Submit(const Work & work, const Release & release, int priority, uint64_t key,
+                              const std::shared_ptr<const CCancelToken> & parent)
+{
+  std::vector<uint64_t> dropped;
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (key != 0) {
+      std::vector<uint64_t> superseded;
+      for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+        const TaskMesherJobStatus status = it->second.status;
+        if (it->second.key == key && (status == TASKMESHER_JOB_PENDING || status == TASKMESHER_JOB_RUNNING)) {
+          superseded.push_back(it->first);
+        }
+      }
+      for (auto it = superseded.begin(); it != superseded.end(); ++it) {
+        cancelLocked(*it, dropped);
+      }
+    }
+
+    id = nextJob_++;
+    CJob & job = jobs_[id];
+    job.work = work;
+    job.release = release;
+    job.priority = priority;
+    job.key = key;
+    job.status = TASKMESHER_JOB_PENDING;
+    job.cancelled = false;
+    job.cancel = std::make_shared<CCancelToken>(parent);
+    job.result = NULL;
+    queue_.insert(std::make_pair(-int64_t(priority), id));
+  }
+  notify(dropped);
+
+  wake_.notify_one();
+  return id;
+}
+
+/*****************************************************************/
+
+TaskMesherJobStatus CMesherEngine::Poll(uint64_t job) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(job);
+  return it != jobs_.end() ? it->second.status : TASKMESHER_JOB_UNKNOWN;
+}
+
+/*****************************************************************/
+
+bool CMesherEngine::Cancel(uint64_t job)
+{
+  std::vector<uint64_t> dropped;
+  bool cancelled = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(job);
+    if (it != jobs_.end() && !it->second.cancelled &&
+        (it->second.status == TASKMESHER_JOB_PENDING || it->second.status == TASKMESHER_JOB_RUNNING)) {
+      cancelLocked(job, dropped);
+      cancelled = true;
+    }
+  }
+  notify(dropped);
+  return cancelled;
+}
+
+/*****************************************************************/
+
+void * CMesherEngine::Take(uint64_t job)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(job);
+  if (it == jobs_.end() || it->second.status == TASKMESHER_JOB_PENDING || it->second.status == TASKMESHER_JOB_RUNNING) {
+    return NULL;
+  }
+
+  void * result = it->second.result;
+  jobs_.erase(it);
+  return result;
+}
+
+/*****************************************************************/
+
+// Queued jobs become final right away and are collected in `dropped` for
+// notify(), running ones are flagged and their token cancelled. Requires
+// mutex_.
+void CMesherEngine::cancelLocked(uint64_t job, std::vector<uint64_t> & dropped)
+{
+  CJob & j = jobs_[job];
+  if (j.status == TASKMESHER_JOB_PENDING) {
+    queue_.erase(std::make_pair(-int64_t(j.priority), job));
+    j.status = TASKMESHER_JOB_CANCELLED;
+    j.work = nullptr;
+    dropped.push_back(job);
+  } else {
+    j.cancelled = true;
+    j.cancel->Cancel();
+  }
+}
+
+void CMesherEngine::notify(const std::vector<uint64_t> & dropped)
+{
+  if (done_) {
+    for (auto it = dropped.begin(); it != dropped.end(); ++it) {
+      done_(*it, TASKMESHER_JOB_CANCELLED);
+    }
+  }
+}
+
+/*****************************************************************/
+
+void CMesherEngine::run()
+{
+  CMesherScratch scratch;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+
+    const uint64_t id = queue_.begin()->second;
+    queue_.erase(queue_.begin());
+    Work work;
+    work.swap(jobs_[id].work);
+    const std::shared_ptr<const CCancelToken> cancel = jobs_[id].cancel;
+    jobs_[id].status = TASKMESHER_JOB_RUNNING;
+    lock.unlock();
+
+    void * result = NULL;
+    try {
+      result = work(scratch, cancel);
+    } catch (...) { // Most likely out of memory, the worker stays usable
+      result = NULL;
+    }
+    work = nullptr;
+
+    // Running jobs are never erased, Take refuses them
+    lock.lock();
+    CJob & job = jobs_[id];
+    job.cancelled |= cancel->IsCancelled(); // Also through the parent token
+    if (job.cancelled) {
+      job.status = TASKMESHER_JOB_CANCELLED;
+    } else if (result) {
+      job.status = TASKMESHER_JOB_DONE;
+      job.result = result;
+    } else {
+      job.status = TASKMESHER_JOB_FAILED;
+    }
+    const TaskMesherJobStatus status = job.status;
+    const Release release = job.cancelled ? job.release : Release();
+    lock.unlock();
+
+    if (release && result) {
+      release(result);
+    }
+    if (done_) {
+      done_(id, status);
+    }
+    lock.lock();
+  }
+}
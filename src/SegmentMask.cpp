@@ -0,0 +1,194 @@
+#include "SegmentMask.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEGMENT_MASK_X86 1
+#endif
+
+/*****************************************************************/
+
+static size_t ScanRowSmallSetScalar(const uint32_t * row, size_t begin, size_t length, const uint32_t * segments, size_t segmentCount,
+                                    size_t & count, size_t & first, size_t & last) {
+  for (size_t x = begin; x < length; ++x) {
+    bool selected = false;
+    for (size_t s = 0; s < segmentCount; ++s) {
+      selected |= row[x] == segments[s];
+    }
+    if (selected) {
+      if (count == 0) first = x;
+      last = x;
+      ++count;
+    }
+  }
+  return count;
+}
+
+static void MaskRowSmallSetScalar(const uint32_t * row, size_t begin, size_t length, const uint32_t * segments, size_t segmentCount,
+                                  uint8_t * mask) {
+  for (size_t x = begin; x < length; ++x) {
+    uint8_t selected = 0;
+    for (size_t s = 0; s < segmentCount; ++s) {
+      selected |= row[x] == segments[s];
+    }
+    mask[x] = selected;
+  }
+}
+
+/*****************************************************************/
+
+#ifdef SEGMENT_MASK_X86
+
+// kByteSpread[bits] has byte i set to bit i of `bits`
+struct CByteSpread {
+  uint64_t table[256];
+  CByteSpread() {
+    for (unsigned bits = 0; bits < 256; ++bits) {
+      table[bits] = 0;
+      for (unsigned i = 0; i < 8; ++i) {
+        table[bits] |= uint64_t((bits >> i) & 1) << (8 * i);
+      }
+    }
+  }
+};
+static const CByteSpread kByteSpread;
+
+static inline void AccumulateLanes(unsigned bits, size_t x, size_t & count, size_t & first, size_t & last) {
+  if (bits) {
+    if (count == 0) first = x + __builtin_ctz(bits);
+    last = x + (31 - __builtin_clz(bits));
+    count += __builtin_popcount(bits);
+  }
+}
+
+/*****************************************************************/
+
+static inline __m128i MatchSSE2(const uint32_t * row, const __m128i * segments, size_t segmentCount) {
+  const __m128i labels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+  __m128i hit = _mm_setzero_si128();
+  for (size_t s = 0; s < segmentCount; ++s) {
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi32(labels, segments[s]));
+  }
+  return hit;
+}
+
+static size_t ScanRowSmallSetSSE2(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount,
+                                  size_t & first, size_t & last) {
+  __m128i seg[SEGMENT_MASK_SIMD_MAX];
+  for (size_t s = 0; s < segmentCount; ++s) {
+    seg[s] = _mm_set1_epi32(static_cast<int>(segments[s]));
+  }
+
+  size_t count = 0;
+  size_t x = 0;
+  for (; x + 4 <= length; x += 4) {
+    const __m128i hit = MatchSSE2(row + x, seg, segmentCount);
+    AccumulateLanes(_mm_movemask_ps(_mm_castsi128_ps(hit)), x, count, first, last);
+  }
+  return ScanRowSmallSetScalar(row, x, length, segments, segmentCount, count, first, last);
+}
+
+static void MaskRowSmallSetSSE2(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount,
+                                uint8_t * mask) {
+  __m128i seg[SEGMENT_MASK_SIMD_MAX];
+  for (size_t s = 0; s < segmentCount; ++s) {
+    seg[s] = _mm_set1_epi32(static_cast<int>(segments[s]));
+  }
+
+  size_t x = 0;
+  for (; x + 4 <= length; x += 4) {
+    const __m128i hit = MatchSSE2(row + x, seg, segmentCount);
+    const uint32_t bytes = static_cast<uint32_t>(kByteSpread.table[_mm_movemask_ps(_mm_castsi128_ps(hit))]);
+    memcpy(mask + x, &bytes, 4);
+  }
+  MaskRowSmallSetScalar(row, x, length, segments, segmentCount, mask);
+}
+
+/*****************************************************************/
+
+__attribute__((target("avx2")))
+static inline __m256i MatchAVX2(const uint32_t * row, const __m256i * segments, size_t segmentCount) {
+  const __m256i labels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row));
+  __m256i hit = _mm256_setzero_si256();
+  for (size_t s = 0; s < segmentCount; ++s) {
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(labels, segments[s]));
+  }
+  return hit;
+}
+
+__attribute__((target("avx2")))
+static size_t ScanRowSmallSetAVX2(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount,
+                                  size_t & first, size_t & last) {
+  __m256i seg[SEGMENT_MASK_SIMD_MAX];
+  for (size_t s = 0; s < segmentCount; ++s) {
+    seg[s] = _mm256_set1_epi32(static_cast<int>(segments[s]));
+  }
+
+  size_t count = 0;
+  size_t x = 0;
+  for (; x + 8 <= length; x += 8) {
+    const __m256i hit = MatchAVX2(row + x, seg, segmentCount);
+    AccumulateLanes(_mm256_movemask_ps(_mm256_castsi256_ps(hit)), x, count, first, last);
+  }
+  return ScanRowSmallSetScalar(row, x, length, segments, segmentCount, count, first, last);
+}
+
+__attribute__((target("avx2")))
+static void MaskRowSmallSetAVX2(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount,
+                                uint8_t * mask) {
+  __m256i seg[SEGMENT_MASK_SIMD_MAX];
+  for (size_t s = 0; s < segmentCount; ++s) {
+    seg[s] = _mm256_set1_epi32(static_cast<int>(segments[s]));
+  }
+
+  size_t x = 0;
+  for (; x + 8 <= length; x += 8) {
+    const __m256i hit = MatchAVX2(row + x, seg, segmentCount);
+    memcpy(mask + x, &kByteSpread.table[_mm256_movemask_ps(_mm256_castsi256_ps(hit))], 8);
+  }
+  MaskRowSmallSetScalar(row, x, length, segments, segmentCount, mask);
+}
+
+#else
+
+static size_t ScanRowSmallSetGeneric(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount,
+                                     size_t & first, size_t & last) {
+  size_t count = 0;
+  return ScanRowSmallSetScalar(row, 0, length, segments, segmentCount, count, first, last);
+}
+
+static void MaskRowSmallSetGeneric(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount,
+                                   uint8_t * mask) {
+  MaskRowSmallSetScalar(row, 0, length, segments, segmentCount, mask);
+}
+
+#endif
+
+/*****************************************************************/
+
+typedef size_t (*ScanRowSmallSetFn)(const uint32_t *, size_t, const uint32_t *, size_t, size_t &, size_t &);
+typedef void (*MaskRowSmallSetFn)(const uint32_t *, size_t, const uint32_t *, size_t, uint8_t *);
+
+#ifdef SEGMENT_MASK_X86
+static bool HasAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+size_t ScanRowSmallSet(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount, size_t & first, size_t & last) {
+#ifdef SEGMENT_MASK_X86
+  static const ScanRowSmallSetFn kernel = HasAVX2() ? ScanRowSmallSetAVX2 : ScanRowSmallSetSSE2;
+#else
+  static const ScanRowSmallSetFn kernel = ScanRowSmallSetGeneric;
+#endif
+  return kernel(row, length, segments, segmentCount, first, last);
+}
+
+void MaskRowSmallSet(const uint32_t * row, size_t length, const uint32_t * segments, size_t segmentCount, uint8_t * mask) {
+#ifdef SEGMENT_MASK_X86
+  static const MaskRowSmallSetFn kernel = HasAVX2() ? MaskRowSmallSetAVX2 : MaskRowSmallSetSSE2;
+#else
+  static const MaskRowSmallSetFn kernel = MaskRowSmallSetGeneric;
+#endif
+  kernel(row, length, segments, segmentCount, mask);
+}
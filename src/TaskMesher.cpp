@@ -1,4 +1,192 @@
 #include "TaskMesher.h"
+#include "MappedVolume.h"
+#include "MesherEngine.h"
+
+/*****************************************************************/
+
+static CTaskMesherOptions GetOptions(const TMesherOptions * options) {
+  return options ? *(const CTaskMesherOptions *)options : CTaskMesherOptions();
+}
+
+template<typename T>
+static TMesher * GenerateChunked(TaskMesherReadPlanes read, void * userData, size_t dim[3], const T * segments, size_t segmentCount,
+                                 uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<T> seg(segments, segments + segmentCount);
+  CBlockReader<T> reader = [read, userData](size_t zBegin, size_t zCount, T * scratch) -> const T * {
+    return read(userData, zBegin, zCount, (unsigned char *)scratch) ? scratch : NULL;
+  };
+
+  CTaskMesher<T> * mesher = new CTaskMesher<T>(reader, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options));
+  if (mesher->ReadFailed()) {
+    delete mesher;
+    return NULL;
+  }
+  return (TMesher *)(mesher);
+}
+
+// Blocks point straight into the mapping, planes before the current block are
+// dropped from memory again.
+template<typename T>
+static TMesher * GenerateFromFile(const char * path, size_t dim[3], const T * segments, size_t segmentCount,
+                                  uint8_t mipCount, const TMesherOptions * options) {
+  const size_t planeBytes = dim[0] * dim[1] * sizeof(T);
+  CMappedVolume file(path);
+  if (!file.valid() || file.size() < planeBytes * dim[2]) {
+    return NULL;
+  }
+
+  std::vector<T> seg(segments, segments + segmentCount);
+  CBlockReader<T> reader = [&file, planeBytes](size_t zBegin, size_t, T *) -> const T * {
+    file.release(0, zBegin * planeBytes);
+    return (const T *)(file.data() + zBegin * planeBytes);
+  };
+
+  return (TMesher *)(new CTaskMesher<T>(reader, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+// Splits the back to back groups, overlapping groups are rejected
+template<typename T>
+static TMesherBatch * GenerateBatch(unsigned char * volume, size_t dim[3], const T * segments, const uint32_t * groupSizes, uint32_t groupCount,
+                                    uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<std::vector<T>> groups(groupCount);
+  for (uint32_t g = 0; g < groupCount; ++g) {
+    groups[g].assign(segments, segments + groupSizes[g]);
+    segments += groupSizes[g];
+  }
+  if (!CTaskMesherBatch<T>::Disjoint(groups)) {
+    return NULL;
+  }
+
+  return (TMesherBatch *)(new CTaskMesherBatch<T>((const T *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), groups, mipCount, GetOptions(options)));
+}
+
+template<typename T>
+static TMesher * GetBatchMesher(TMesherBatch * batch, uint32_t group) {
+  CTaskMesherBatch<T> * b = (CTaskMesherBatch<T> *)(batch);
+  return group < b->Size() ? (TMesher *)(b->GetMesher(group)) : NULL;
+}
+
+static CCompressedSegmentation GetCompressed(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes) {
+  return CCompressedSegmentation((const uint32_t *)data, length / sizeof(uint32_t), zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]),
+                                 zi::vl::vec<size_t, 3>(blockSize[0], blockSize[1], blockSize[2]), labelBytes / sizeof(uint32_t));
+}
+
+template<typename T>
+static TMesher * GenerateCompressed(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes,
+                                    const T * segments, size_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<T> seg(segments, segments + segmentCount);
+  CTaskMesher<T> * mesher = new CTaskMesher<T>(GetCompressed(data, length, dim, blockSize, labelBytes), seg, mipCount, GetOptions(options));
+  if (mesher->ReadFailed()) {
+    delete mesher;
+    return NULL;
+  }
+  return (TMesher *)(mesher);
+}
+
+template<typename T>
+static const unsigned char * CompressSegmentation(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length) {
+  const std::vector<uint32_t> words = CompressSegmentation<T>((const T *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]),
+                                                               zi::vl::vec<size_t, 3>(blockSize[0], blockSize[1], blockSize[2]));
+  *length = words.size() * sizeof(uint32_t);
+  if (words.empty()) {
+    return NULL;
+  }
+  uint32_t * data = new uint32_t[words.size()];
+  memcpy(data, words.data(), *length);
+  return (const unsigned char *)(data);
+}
+
+template<typename T>
+static TMesherIndex * CreateIndex(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount) {
+  return (TMesherIndex *)(new CSegmentIndex<T>((const T *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), blockSize, threadCount));
+}
+
+template<typename T>
+static size_t SerializeIndex(TMesherIndex * index, unsigned char * buffer, size_t capacity) {
+  std::vector<char> data;
+  ((CSegmentIndex<T> *)(index))->serialize(data);
+  if (buffer && data.size() <= capacity) {
+    memcpy(buffer, data.data(), data.size());
+  }
+  return data.size();
+}
+
+template<typename T>
+static TMesherIndex * LoadIndex(const unsigned char * data, size_t length) {
+  CSegmentIndex<T> * index = new CSegmentIndex<T>((const char *)data, length);
+  if (!index->valid()) {
+    delete index;
+    return NULL;
+  }
+  return (TMesherIndex *)(index);
+}
+
+template<typename T>
+static TMesher * GenerateIndexed(unsigned char * volume, TMesherIndex * index, const T * segments, size_t segmentCount,
+                                 uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<T> seg(segments, segments + segmentCount);
+  CTaskMesher<T> * mesher = new CTaskMesher<T>((const T *)volume, *(const CSegmentIndex<T> *)(index), seg, mipCount, GetOptions(options));
+  if (mesher->ReadFailed()) {
+    delete mesher;
+    return NULL;
+  }
+  return (TMesher *)(mesher);
+}
+
+template<typename T>
+static uint64_t CacheKey(unsigned char * volume, size_t dim[3], const T * segments, size_t segmentCount, uint8_t mipCount,
+                         const TMesherOptions * options) {
+  return MeshCacheKey<T>((const T *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), std::vector<T>(segments, segments + segmentCount),
+                         mipCount, GetOptions(options));
+}
+
+template<typename T>
+static uint64_t CacheKeyCompressed(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes,
+                                   const T * segments, size_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return MeshCacheKey<T>(GetCompressed(data, length, dim, blockSize, labelBytes), std::vector<T>(segments, segments + segmentCount),
+                         mipCount, GetOptions(options));
+}
+
+template<typename T>
+static uint8_t SaveCache(TMesher * taskmesher, uint64_t key, const char * path) {
+  std::vector<char> blob;
+  return ((CTaskMesher<T> *)(taskmesher))->Serialize(key, blob) && WriteFileAtomic(path, blob);
+}
+
+// Maps the blob, the mesher serves its meshes straight from the mapping
+template<typename T>
+static TMesher * LoadCache(const char * path, uint64_t key) {
+  CTaskMesher<T> * mesher = new CTaskMesher<T>(std::make_shared<CMeshBlob>(std::string(path)), key);
+  if (mesher->ReadFailed()) {
+    delete mesher;
+    return NULL;
+  }
+  return (TMesher *)(mesher);
+}
+
+template<typename T>
+static uint64_t Submit(TMesherEngine * engine, unsigned char * volume, size_t dim[3], const T * segments, size_t segmentCount,
+                       uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  std::vector<T> seg(segments, segments + segmentCount);
+  return ((CMesherEngine *)(engine))->SubmitMesh<T>((const T *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount,
+                                                    GetOptions(options), priority, key);
+}
+
+template<typename T>
+static uint64_t SubmitCompressed(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes,
+                                 const T * segments, size_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  std::vector<T> seg(segments, segments + segmentCount);
+  return ((CMesherEngine *)(engine))->SubmitMesh<T>(GetCompressed(data, length, dim, blockSize, labelBytes), seg, mipCount,
+                                                    GetOptions(options), priority, key);
+}
+
+template<typename T>
+static uint64_t SubmitIndexed(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, const T * segments, size_t segmentCount,
+                              uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  std::vector<T> seg(segments, segments + segmentCount);
+  return ((CMesherEngine *)(engine))->SubmitMesh<T>((const T *)volume, *(const CSegmentIndex<T> *)(index), seg, mipCount,
+                                                    GetOptions(options), priority, key);
+}
 
 /*****************************************************************/
 
@@ -20,6 +208,401 @@ extern "C" TMesher * TaskMesher_Generate_uint32(unsigned char * volume, size_t d
   return (TMesher *)(new CTaskMesher<uint32_t>(std::move(vol), zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount));
 }
 
+extern "C" TMesher * TaskMesher_GenerateWithOptions_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<uint8_t> seg(segments, segments + segmentCount);
+  std::vector<uint8_t> vol((uint8_t *)volume, (uint8_t *)volume + dim[0]*dim[1]*dim[2]);
+  return (TMesher *)(new CTaskMesher<uint8_t>(std::move(vol), zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+extern "C" TMesher * TaskMesher_GenerateWithOptions_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<uint16_t> seg(segments, segments + segmentCount);
+  std::vector<uint16_t> vol((uint16_t *)volume, (uint16_t *)volume + dim[0]*dim[1]*dim[2]);
+  return (TMesher *)(new CTaskMesher<uint16_t>(std::move(vol), zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+extern "C" TMesher * TaskMesher_GenerateWithOptions_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<uint32_t> seg(segments, segments + segmentCount);
+  std::vector<uint32_t> vol((uint32_t *)volume, (uint32_t *)volume + dim[0]*dim[1]*dim[2]);
+  return (TMesher *)(new CTaskMesher<uint32_t>(std::move(vol), zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+/*****************************************************************/
+
+extern "C" TMesher * TaskMesher_GenerateInPlace_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<uint8_t> seg(segments, segments + segmentCount);
+  return (TMesher *)(new CTaskMesher<uint8_t>((const uint8_t *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+extern "C" TMesher * TaskMesher_GenerateInPlace_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<uint16_t> seg(segments, segments + segmentCount);
+  return (TMesher *)(new CTaskMesher<uint16_t>((const uint16_t *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+extern "C" TMesher * TaskMesher_GenerateInPlace_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  std::vector<uint32_t> seg(segments, segments + segmentCount);
+  return (TMesher *)(new CTaskMesher<uint32_t>((const uint32_t *)volume, zi::vl::vec<size_t, 3>(dim[0], dim[1], dim[2]), seg, mipCount, GetOptions(options)));
+}
+
+/*****************************************************************/
+
+extern "C" TMesher * TaskMesher_GenerateChunked_uint8(TaskMesherReadPlanes read, void * userData, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateChunked<uint8_t>(read, userData, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateChunked_uint16(TaskMesherReadPlanes read, void * userData, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateChunked<uint16_t>(read, userData, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateChunked_uint32(TaskMesherReadPlanes read, void * userData, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateChunked<uint32_t>(read, userData, dim, segments, segmentCount, mipCount, options);
+}
+
+/*****************************************************************/
+
+extern "C" TMesher * TaskMesher_GenerateFromFile_uint8(const char * path, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateFromFile<uint8_t>(path, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateFromFile_uint16(const char * path, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateFromFile<uint16_t>(path, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateFromFile_uint32(const char * path, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateFromFile<uint32_t>(path, dim, segments, segmentCount, mipCount, options);
+}
+
+/*****************************************************************/
+
+extern "C" TMesher * TaskMesher_GenerateCompressed_uint8(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateCompressed<uint8_t>(data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateCompressed_uint16(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateCompressed<uint16_t>(data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateCompressed_uint32(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateCompressed<uint32_t>(data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options);
+}
+
+extern "C" const unsigned char * TaskMesher_CompressSegmentation_uint8(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length) {
+  return CompressSegmentation<uint8_t>(volume, dim, blockSize, length);
+}
+
+extern "C" const unsigned char * TaskMesher_CompressSegmentation_uint16(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length) {
+  return CompressSegmentation<uint16_t>(volume, dim, blockSize, length);
+}
+
+extern "C" const unsigned char * TaskMesher_CompressSegmentation_uint32(unsigned char * volume, size_t dim[3], size_t blockSize[3], size_t * length) {
+  return CompressSegmentation<uint32_t>(volume, dim, blockSize, length);
+}
+
+extern "C" void TaskMesher_ReleaseCompressed(const unsigned char * data) {
+  delete[] (const uint32_t *)(data);
+}
+
+/*****************************************************************/
+
+extern "C" TMesherIndex * TaskMesher_CreateIndex_uint8(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount) {
+  return CreateIndex<uint8_t>(volume, dim, blockSize, threadCount);
+}
+
+extern "C" TMesherIndex * TaskMesher_CreateIndex_uint16(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount) {
+  return CreateIndex<uint16_t>(volume, dim, blockSize, threadCount);
+}
+
+extern "C" TMesherIndex * TaskMesher_CreateIndex_uint32(unsigned char * volume, size_t dim[3], uint32_t blockSize, uint8_t threadCount) {
+  return CreateIndex<uint32_t>(volume, dim, blockSize, threadCount);
+}
+
+extern "C" size_t TaskMesher_SerializeIndex_uint8(TMesherIndex * index, unsigned char * buffer, size_t capacity) {
+  return SerializeIndex<uint8_t>(index, buffer, capacity);
+}
+
+extern "C" size_t TaskMesher_SerializeIndex_uint16(TMesherIndex * index, unsigned char * buffer, size_t capacity) {
+  return SerializeIndex<uint16_t>(index, buffer, capacity);
+}
+
+extern "C" size_t TaskMesher_SerializeIndex_uint32(TMesherIndex * index, unsigned char * buffer, size_t capacity) {
+  return SerializeIndex<uint32_t>(index, buffer, capacity);
+}
+
+extern "C" TMesherIndex * TaskMesher_LoadIndex_uint8(const unsigned char * data, size_t length) {
+  return LoadIndex<uint8_t>(data, length);
+}
+
+extern "C" TMesherIndex * TaskMesher_LoadIndex_uint16(const unsigned char * data, size_t length) {
+  return LoadIndex<uint16_t>(data, length);
+}
+
+extern "C" TMesherIndex * TaskMesher_LoadIndex_uint32(const unsigned char * data, size_t length) {
+  return LoadIndex<uint32_t>(data, length);
+}
+
+extern "C" void TaskMesher_ReleaseIndex_uint8(TMesherIndex * index) {
+  delete (CSegmentIndex<uint8_t>*)(index);
+}
+
+extern "C" void TaskMesher_ReleaseIndex_uint16(TMesherIndex * index) {
+  delete (CSegmentIndex<uint16_t>*)(index);
+}
+
+extern "C" void TaskMesher_ReleaseIndex_uint32(TMesherIndex * index) {
+  delete (CSegmentIndex<uint32_t>*)(index);
+}
+
+extern "C" TMesher * TaskMesher_GenerateIndexed_uint8(unsigned char * volume, TMesherIndex * index, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateIndexed<uint8_t>(volume, index, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateIndexed_uint16(unsigned char * volume, TMesherIndex * index, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateIndexed<uint16_t>(volume, index, segments, segmentCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GenerateIndexed_uint32(unsigned char * volume, TMesherIndex * index, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateIndexed<uint32_t>(volume, index, segments, segmentCount, mipCount, options);
+}
+
+/*****************************************************************/
+
+extern "C" TMesherBatch * TaskMesher_GenerateBatch_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint32_t * groupSizes, uint32_t groupCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateBatch<uint8_t>(volume, dim, segments, groupSizes, groupCount, mipCount, options);
+}
+
+extern "C" TMesherBatch * TaskMesher_GenerateBatch_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint32_t * groupSizes, uint32_t groupCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateBatch<uint16_t>(volume, dim, segments, groupSizes, groupCount, mipCount, options);
+}
+
+extern "C" TMesherBatch * TaskMesher_GenerateBatch_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t * groupSizes, uint32_t groupCount, uint8_t mipCount, const TMesherOptions * options) {
+  return GenerateBatch<uint32_t>(volume, dim, segments, groupSizes, groupCount, mipCount, options);
+}
+
+extern "C" TMesher * TaskMesher_GetBatchMesher_uint8(TMesherBatch * batch, uint32_t group) {
+  return GetBatchMesher<uint8_t>(batch, group);
+}
+
+extern "C" TMesher * TaskMesher_GetBatchMesher_uint16(TMesherBatch * batch, uint32_t group) {
+  return GetBatchMesher<uint16_t>(batch, group);
+}
+
+extern "C" TMesher * TaskMesher_GetBatchMesher_uint32(TMesherBatch * batch, uint32_t group) {
+  return GetBatchMesher<uint32_t>(batch, group);
+}
+
+extern "C" void TaskMesher_ReleaseBatch_uint8(TMesherBatch * batch) {
+  delete (CTaskMesherBatch<uint8_t>*)(batch);
+}
+
+extern "C" void TaskMesher_ReleaseBatch_uint16(TMesherBatch * batch) {
+  delete (CTaskMesherBatch<uint16_t>*)(batch);
+}
+
+extern "C" void TaskMesher_ReleaseBatch_uint32(TMesherBatch * batch) {
+  delete (CTaskMesherBatch<uint32_t>*)(batch);
+}
+
+/*****************************************************************/
+
+extern "C" uint64_t TaskMesher_CacheKey_uint8(unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return CacheKey<uint8_t>(volume, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" uint64_t TaskMesher_CacheKey_uint16(unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return CacheKey<uint16_t>(volume, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" uint64_t TaskMesher_CacheKey_uint32(unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return CacheKey<uint32_t>(volume, dim, segments, segmentCount, mipCount, options);
+}
+
+extern "C" uint64_t TaskMesher_CacheKeyCompressed_uint8(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return CacheKeyCompressed<uint8_t>(data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options);
+}
+
+extern "C" uint64_t TaskMesher_CacheKeyCompressed_uint16(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return CacheKeyCompressed<uint16_t>(data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options);
+}
+
+extern "C" uint64_t TaskMesher_CacheKeyCompressed_uint32(const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options) {
+  return CacheKeyCompressed<uint32_t>(data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options);
+}
+
+extern "C" uint8_t TaskMesher_SaveCache_uint8(TMesher * taskmesher, uint64_t key, const char * path) {
+  return SaveCache<uint8_t>(taskmesher, key, path);
+}
+
+extern "C" uint8_t TaskMesher_SaveCache_uint16(TMesher * taskmesher, uint64_t key, const char * path) {
+  return SaveCache<uint16_t>(taskmesher, key, path);
+}
+
+extern "C" uint8_t TaskMesher_SaveCache_uint32(TMesher * taskmesher, uint64_t key, const char * path) {
+  return SaveCache<uint32_t>(taskmesher, key, path);
+}
+
+extern "C" TMesher * TaskMesher_LoadCache_uint8(const char * path, uint64_t key) {
+  return LoadCache<uint8_t>(path, key);
+}
+
+extern "C" TMesher * TaskMesher_LoadCache_uint16(const char * path, uint64_t key) {
+  return LoadCache<uint16_t>(path, key);
+}
+
+extern "C" TMesher * TaskMesher_LoadCache_uint32(const char * path, uint64_t key) {
+  return LoadCache<uint32_t>(path, key);
+}
+
+/*****************************************************************/
+
+extern "C" TMesherEngine * TaskMesher_CreateEngine(uint8_t threadCount, TaskMesherJobDone done, void * userData) {
+  CMesherEngine::Callback callback;
+  if (done) {
+    callback = [done, userData](uint64_t job, TaskMesherJobStatus status) { done(userData, job, status); };
+  }
+  return (TMesherEngine *)(new CMesherEngine(threadCount, callback));
+}
+
+extern "C" void TaskMesher_ReleaseEngine(TMesherEngine * engine) {
+  delete (CMesherEngine *)(engine);
+}
+
+extern "C" uint64_t TaskMesher_Submit_uint8(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return Submit<uint8_t>(engine, volume, dim, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_Submit_uint16(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return Submit<uint16_t>(engine, volume, dim, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_Submit_uint32(TMesherEngine * engine, unsigned char * volume, size_t dim[3], uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return Submit<uint32_t>(engine, volume, dim, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_SubmitCompressed_uint8(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return SubmitCompressed<uint8_t>(engine, data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_SubmitCompressed_uint16(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return SubmitCompressed<uint16_t>(engine, data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_SubmitCompressed_uint32(TMesherEngine * engine, const unsigned char * data, size_t length, size_t dim[3], size_t blockSize[3], uint8_t labelBytes, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return SubmitCompressed<uint32_t>(engine, data, length, dim, blockSize, labelBytes, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_SubmitIndexed_uint8(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, uint8_t * segments, uint8_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return SubmitIndexed<uint8_t>(engine, volume, index, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_SubmitIndexed_uint16(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, uint16_t * segments, uint16_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return SubmitIndexed<uint16_t>(engine, volume, index, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint64_t TaskMesher_SubmitIndexed_uint32(TMesherEngine * engine, unsigned char * volume, TMesherIndex * index, uint32_t * segments, uint32_t segmentCount, uint8_t mipCount, const TMesherOptions * options, int32_t priority, uint64_t key) {
+  return SubmitIndexed<uint32_t>(engine, volume, index, segments, segmentCount, mipCount, options, priority, key);
+}
+
+extern "C" uint8_t TaskMesher_PollJob(TMesherEngine * engine, uint64_t job) {
+  return ((CMesherEngine *)(engine))->Poll(job);
+}
+
+extern "C" uint8_t TaskMesher_CancelJob(TMesherEngine * engine, uint64_t job) {
+  return ((CMesherEngine *)(engine))->Cancel(job) ? 1 : 0;
+}
+
+extern "C" TMesher * TaskMesher_TakeJob(TMesherEngine * engine, uint64_t job) {
+  return (TMesher *)(((CMesherEngine *)(engine))->Take(job));
+}
+
+/*****************************************************************/
+
+extern "C" TMesherOptions * TaskMesher_CreateOptions() {
+  return (TMesherOptions *)(new CTaskMesherOptions());
+}
+
+extern "C" void TaskMesher_ReleaseOptions(TMesherOptions * options) {
+  delete (CTaskMesherOptions *)(options);
+}
+
+extern "C" void TaskMesher_SetIndependentLods(TMesherOptions * options, uint8_t enable) {
+  ((CTaskMesherOptions *)(options))->independentLods = enable != 0;
+}
+
+extern "C" void TaskMesher_SetThreadCount(TMesherOptions * options, uint8_t threadCount) {
+  ((CTaskMesherOptions *)(options))->threadCount = std::max<uint8_t>(threadCount, 1);
+}
+
+extern "C" void TaskMesher_SetOutputFormats(TMesherOptions * options, uint8_t formats) {
+  ((CTaskMesherOptions *)(options))->outputFormats = formats;
+}
+
+extern "C" void TaskMesher_SetLodMode(TMesherOptions * options, uint8_t lodMode) {
+  ((CTaskMesherOptions *)(options))->lodMode = lodMode;
+}
+
+extern "C" void TaskMesher_SetVerbose(TMesherOptions * options, uint8_t enable) {
+  ((CTaskMesherOptions *)(options))->verbose = enable != 0;
+}
+
+extern "C" void TaskMesher_SetBlockBytes(TMesherOptions * options, size_t bytes) {
+  ((CTaskMesherOptions *)(options))->blockBytes = bytes;
+}
+
+extern "C" void TaskMesher_SetFillHoles(TMesherOptions * options, uint8_t enable) {
+  ((CTaskMesherOptions *)(options))->fillHoles = enable != 0;
+}
+
+extern "C" void TaskMesher_SetPreview(TMesherOptions * options, size_t previewDim[3]) {
+  for (int i = 0; i < 3; ++i) {
+    ((CTaskMesherOptions *)(options))->previewDim[i] = previewDim[i];
+  }
+}
+
+extern "C" void TaskMesher_SetTransform(TMesherOptions * options, float affine[12]) {
+  ((CTaskMesherOptions *)(options))->transform = CVertexTransform(affine);
+}
+
+extern "C" void TaskMesher_SetTimeLimit(TMesherOptions * options, double seconds) {
+  ((CTaskMesherOptions *)(options))->timeLimit = seconds;
+}
+
+extern "C" void TaskMesher_SetLodPolicy(TMesherOptions * options, uint8_t policy, const double * targets, uint8_t count) {
+  ((CTaskMesherOptions *)(options))->lodPolicy = policy;
+  ((CTaskMesherOptions *)(options))->lodTargets.assign(targets, targets + count);
+}
+
+/*****************************************************************/
+
+// A handle holds one reference to the token, options and meshers their own
+extern "C" TMesherCancelToken * TaskMesher_CreateCancelToken() {
+  return (TMesherCancelToken *)(new std::shared_ptr<CCancelToken>(std::make_shared<CCancelToken>()));
+}
+
+extern "C" void TaskMesher_CancelToken(TMesherCancelToken * token) {
+  (*(std::shared_ptr<CCancelToken> *)(token))->Cancel();
+}
+
+extern "C" void TaskMesher_ReleaseCancelToken(TMesherCancelToken * token) {
+  delete (std::shared_ptr<CCancelToken> *)(token);
+}
+
+extern "C" void TaskMesher_SetCancelToken(TMesherOptions * options, TMesherCancelToken * token) {
+  ((CTaskMesherOptions *)(options))->cancelToken = *(std::shared_ptr<CCancelToken> *)(token);
+}
+
+/*****************************************************************/
+
+extern "C" uint8_t TaskMesher_GetStatus_uint8(TMesher * taskmesher) {
+  return ((CTaskMesher<uint8_t>*)(taskmesher))->GetStatus();
+}
+
+extern "C" uint8_t TaskMesher_GetStatus_uint16(TMesher * taskmesher) {
+  return ((CTaskMesher<uint16_t>*)(taskmesher))->GetStatus();
+}
+
+extern "C" uint8_t TaskMesher_GetStatus_uint32(TMesher * taskmesher) {
+  return ((CTaskMesher<uint32_t>*)(taskmesher))->GetStatus();
+}
+
 /*****************************************************************/
 
 extern "C" void TaskMesher_Release_uint8(TMesher * taskmesher) {
@@ -70,6 +653,40 @@ extern "C" void TaskMesher_GetSimplifiedMesh_uint32(TMesher * taskmesher, uint8_
 
 /*****************************************************************/
 
+extern "C" void TaskMesher_GetRawIndexedMesh_uint8(TMesher * taskmesher, const char ** data, size_t * length)
+{
+  ((CTaskMesher<uint8_t>*)(taskmesher))->GetIndexedMesh(0, data, length);
+}
+
+extern "C" void TaskMesher_GetRawIndexedMesh_uint16(TMesher * taskmesher, const char ** data, size_t * length)
+{
+  ((CTaskMesher<uint16_t>*)(taskmesher))->GetIndexedMesh(0, data, length);
+}
+
+extern "C" void TaskMesher_GetRawIndexedMesh_uint32(TMesher * taskmesher, const char ** data, size_t * length)
+{
+  ((CTaskMesher<uint32_t>*)(taskmesher))->GetIndexedMesh(0, data, length);
+}
+
+/*****************************************************************/
+
+extern "C" void TaskMesher_GetSimplifiedIndexedMesh_uint8(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length)
+{
+  ((CTaskMesher<uint8_t>*)(taskmesher))->GetIndexedMesh(1 + lod, data, length);
+}
+
+extern "C" void TaskMesher_GetSimplifiedIndexedMesh_uint16(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length)
+{
+  ((CTaskMesher<uint16_t>*)(taskmesher))->GetIndexedMesh(1 + lod, data, length);
+}
+
+extern "C" void TaskMesher_GetSimplifiedIndexedMesh_uint32(TMesher * taskmesher, uint8_t lod, const char ** data, size_t * length)
+{
+  ((CTaskMesher<uint32_t>*)(taskmesher))->GetIndexedMesh(1 + lod, data, length);
+}
+
+/*****************************************************************/
+
 extern "C" void TaskMesher_ScaleVolume_uint8(unsigned char * in_volume, size_t from_dim[3], size_t to_dim[3], unsigned char * out_buffer) {
   ScaleVolume((uint8_t*)in_volume, from_dim, to_dim, (uint8_t*)out_buffer);
 }
@@ -99,4 +716,21 @@ extern "C" void TaskMesher_ScaleMesh_uint32(TMesher * taskmesher, float scaleFac
   ((CTaskMesher<uint32_t>*)(taskmesher))->ScaleMesh(scaleFactor);
 }
 
+/*****************************************************************/
+
+extern "C" void TaskMesher_GetStats_uint8(TMesher * taskmesher, TaskMesherStats * stats)
+{
+  *stats = ((CTaskMesher<uint8_t>*)(taskmesher))->GetStats();
+}
+
+extern "C" void TaskMesher_GetStats_uint16(TMesher * taskmesher, TaskMesherStats * stats)
+{
+  *stats = ((CTaskMesher<uint16_t>*)(taskmesher))->GetStats();
+}
+
+extern "C" void TaskMesher_GetStats_uint32(TMesher * taskmesher, TaskMesherStats * stats)
+{
+  *stats = ((CTaskMesher<uint32_t>*)(taskmesher))->GetStats();
+}
+
 /*****************************************************************/
\ No newline at end of file
@@ -0,0 +1,340 @@
+// Regression tests for the task mesher.
+//
+// Meshes the synthetic segmentations of the benchmark through every input
+// path (in place with several thread counts, chunked, compressed, indexed)
+// and checks that strip and indexed output of every LOD are byte identical
+// to the serial full-volume mesh. A stacked volume puts slab and block edges
+// exactly on object boundaries. Cropped marching is checked against the
+// whole volume, fillHoles against a BFS fill on random cavities. Prints one
+// line per failed check, exits 1 if any failed.
+//
+//   test_taskmesher [--seed 1]
+
+#include "TaskMesher.h"
+#include "SyntheticVolumes.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*****************************************************************/
+
+static int failures = 0;
+static int checks = 0;
+
+static void Check(bool ok, const std::string & what) {
+  ++checks;
+  if (!ok) {
+    printf("FAILED %s\n", what.c_str());
+    ++failures;
+  }
+}
+
+// Status and serialized LODs of a mesher
+struct CMeshOutput {
+  TaskMesherResult         status;
+  std::vector<std::string> strips;
+  std::vector<std::string> indexed;
+};
+
+template<typename T>
+static CMeshOutput Collect(CTaskMesher<T> & mesher, uint8_t mipCount) {
+  CMeshOutput out;
+  out.status = mesher.GetStatus();
+  for (uint8_t lod = 0; lod <= mipCount; ++lod) {
+    const char * data = NULL;
+    size_t length = 0;
+    mesher.GetMesh(lod, &data, &length);
+    out.strips.push_back(std::string(data, length));
+    mesher.GetIndexedMesh(lod, &data, &length);
+    out.indexed.push_back(std::string(data, length));
+  }
+  return out;
+}
+
+static void Compare(const CMeshOutput & expected, const CMeshOutput & actual, const std::string & name) {
+  Check(actual.status == expected.status, name + ": status " + std::to_string(actual.status));
+  for (size_t lod = 0; lod < expected.strips.size(); ++lod) {
+    Check(actual.strips[lod] == expected.strips[lod], name + ": strip of LOD " + std::to_string(lod));
+    Check(actual.indexed[lod] == expected.indexed[lod], name + ": indexed mesh of LOD " + std::to_string(lod));
+  }
+}
+
+/*****************************************************************/
+
+struct CTestVolume {
+  std::string name;
+  size_t      n;
+  size_t      objectPlanes; // > 0: objects start and end on multiples of it along z
+};
+
+// Boxes stacked along z, objectPlanes thick, every other one selected. The
+// selection starts at z = 0, so marchBlock's slabs split its cube layers
+// into multiples of objectPlanes for 3 threads.
+template<typename T>
+static std::vector<T> GenerateStack(size_t n, size_t objectPlanes, std::vector<T> & segments) {
+  std::vector<T> volume(n * n * n, 0);
+  for (size_t z = 0; z < 3 * objectPlanes; ++z) {
+    for (size_t y = 4; y + 4 < n; ++y) {
+      for (size_t x = 4; x + 4 < n; ++x) {
+        volume[x + n * (y + n * z)] = static_cast<T>(1 + (z / objectPlanes) % 2);
+      }
+    }
+  }
+  segments.push_back(1);
+  return volume;
+}
+
+template<typename T>
+static void TestInputPaths(const CTestVolume & v, const std::string & type, uint64_t seed) {
+  const uint8_t mipCount = 2;
+  std::vector<T> segments;
+  const std::vector<T> volume = v.objectPlanes > 0 ? GenerateStack<T>(v.n, v.objectPlanes, segments)
+                                                   : GenerateVolume<T>(v.name, v.n, seed, segments);
+  const zi::vl::vec<size_t, 3> dim(v.n, v.n, v.n);
+  const size_t planeSize = v.n * v.n;
+  const std::string prefix = v.name + " " + type + " " + std::to_string(v.n) + ": ";
+
+  CTaskMesherOptions options;
+  options.outputFormats = TASKMESHER_FORMAT_DEGENERATE_STRIP | TASKMESHER_FORMAT_INDEXED;
+
+  CTaskMesher<T> serial(volume.data(), dim, segments, mipCount, options);
+  const CMeshOutput expected = Collect(serial, mipCount);
+  Check(expected.status == TASKMESHER_RESULT_OK && expected.strips[0].size() > 0, prefix + "serial mesh is empty");
+
+  const size_t threadCounts[] = { 2, 3, 4, 8 };
+  for (size_t threads : threadCounts) {
+    CTaskMesherOptions o = options;
+    o.threadCount = threads;
+    CTaskMesher<T> mesher(volume.data(), dim, segments, mipCount, o);
+    Compare(expected, Collect(mesher, mipCount), prefix + std::to_string(threads) + " threads");
+  }
+
+  // Chunked: z-blocks of `planes` cube layers, objectPlanes puts block edges on object boundaries
+  std::vector<size_t> blockPlanes = { 1, 2, 7, v.n };
+  if (v.objectPlanes > 0) {
+    blockPlanes.push_back(v.objectPlanes);
+    blockPlanes.push_back(2 * v.objectPlanes);
+  }
+  const CBlockReader<T> reader = [&](size_t zBegin, size_t, T *) { return volume.data() + zBegin * planeSize; };
+  for (size_t planes : blockPlanes) {
+    for (size_t threads = 1; threads <= 3; threads += 2) {
+      CTaskMesherOptions o = options;
+      o.blockBytes = (planes + 1) * planeSize * sizeof(T);
+      o.threadCount = threads;
+      CTaskMesher<T> mesher(reader, dim, segments, mipCount, o);
+      Compare(expected, Collect(mesher, mipCount),
+              prefix + "chunked, " + std::to_string(planes) + " planes, " + std::to_string(threads) + " threads");
+    }
+  }
+
+  // Compressed, with blocks that don't divide the volume
+  std::vector<zi::vl::vec<size_t, 3>> compressedBlocks = { zi::vl::vec<size_t, 3>(8, 8, 8), zi::vl::vec<size_t, 3>(4, 4, 4),
+                                                           zi::vl::vec<size_t, 3>(16, 8, 4), zi::vl::vec<size_t, 3>(5, 7, 3) };
+  if (v.objectPlanes > 0) {
+    compressedBlocks.push_back(zi::vl::vec<size_t, 3>(8, 8, v.objectPlanes));
+  }
+  for (const zi::vl::vec<size_t, 3> & block : compressedBlocks) {
+    const std::vector<uint32_t> words = CompressSegmentation<T>(volume.data(), dim, block);
+    const std::string name = prefix + "compressed " + std::to_string(block[0]) + "x" + std::to_string(block[1]) + "x" + std::to_string(block[2]);
+    Check(!words.empty(), name + ": encoding failed");
+    if (words.empty()) continue;
+    CTaskMesherOptions o = options;
+    o.threadCount = 3;
+    CTaskMesher<T> mesher(CCompressedSegmentation(words.data(), words.size(), dim, block), segments, mipCount, o);
+    Compare(expected, Collect(mesher, mipCount), name);
+  }
+
+  // Segment index, only the occupied index blocks are marched
+  std::vector<size_t> indexBlocks = { 4, 8, SEGMENT_INDEX_BLOCK, 32 };
+  if (v.objectPlanes > 0) {
+    indexBlocks.push_back(v.objectPlanes);
+  }
+  for (size_t block : indexBlocks) {
+    for (size_t threads = 1; threads <= 3; threads += 2) {
+      const CSegmentIndex<T> index(volume.data(), dim, block, threads);
+      CTaskMesherOptions o = options;
+      o.threadCount = threads;
+      CTaskMesher<T> mesher(volume.data(), index, segments, mipCount, o);
+      Compare(expected, Collect(mesher, mipCount),
+              prefix + "index blocks " + std::to_string(block) + ", " + std::to_string(threads) + " threads");
+    }
+  }
+}
+
+/*****************************************************************/
+
+// marchBlock marches the selection box and moves its triangles with
+// TranslateTriangles, which relies on zi's packed vertex layout. Marching a
+// random box cropped has to give exactly the triangles of the whole volume.
+static void TestCropping(uint64_t seed) {
+  Check(PackedVertexLayoutMatches(), "zi marching cubes packs vertices differently than TranslateTriangles assumes");
+
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  for (int trial = 0; trial < 8; ++trial) {
+    std::uniform_int_distribution<size_t> side(6, 30);
+    const zi::vl::vec<size_t, 3> dim(side(rng), side(rng), side(rng));
+    zi::vl::vec<size_t, 3> origin, extent;
+    std::vector<uint8_t> volume(dim[0] * dim[1] * dim[2], 0);
+    for (int i = 0; i < 3; ++i) {
+      origin[i] = 1 + size_t(unit(rng) * (dim[i] - 4));
+      extent[i] = 3 + size_t(unit(rng) * (dim[i] - origin[i] - 3));
+    }
+    for (size_t z = origin[2] + 1; z + 1 < origin[2] + extent[2]; ++z) {
+      for (size_t y = origin[1] + 1; y + 1 < origin[1] + extent[1]; ++y) {
+        for (size_t x = origin[0] + 1; x + 1 < origin[0] + extent[0]; ++x) {
+          volume[x + dim[0] * (y + dim[1] * z)] = unit(rng) < 0.6;
+        }
+      }
+    }
+
+    std::vector<uint8_t> block(extent[0] * extent[1] * extent[2]);
+    for (size_t z = 0; z < extent[2]; ++z) {
+      for (size_t y = 0; y < extent[1]; ++y) {
+        for (size_t x = 0; x < extent[0]; ++x) {
+          block[x + extent[0] * (y + extent[1] * z)] = volume[origin[0] + x + dim[0] * (origin[1] + y + dim[1] * (origin[2] + z))];
+        }
+      }
+    }
+
+    zi::mesh::marching_cubes<uint8_t> whole, cropped;
+    whole.marche(volume.data(), dim[2], dim[1], dim[0]);
+    cropped.marche(block.data(), extent[2], extent[1], extent[0]);
+    const MCTriangles<uint8_t> expected = whole.get_triangles(1);
+    MCTriangles<uint8_t> triangles = cropped.get_triangles(1);
+    TranslateTriangles(triangles, origin[2], origin[1], origin[0]);
+
+    bool same = triangles.size() == expected.size() && !expected.empty();
+    for (size_t i = 0; same && i < expected.size(); ++i) {
+      same = triangles[i][0] == expected[i][0] && triangles[i][1] == expected[i][1] && triangles[i][2] == expected[i][2];
+    }
+    Check(same, "cropping trial " + std::to_string(trial) + ": translated triangles differ from the uncropped ones");
+  }
+}
+
+/*****************************************************************/
+
+// fillHoles against a plain BFS: every unselected voxel 6-connected to the
+// volume border stays outside, all others are meshed. Random hollow balls
+// (some opened by a tunnel) and noise give cavities of all shapes, dimensions
+// differ per axis.
+static void TestFillHoles(uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  for (int trial = 0; trial < 24; ++trial) {
+    std::uniform_int_distribution<size_t> side(8, 40);
+    const zi::vl::vec<size_t, 3> dim(side(rng), side(rng), side(rng));
+    const size_t voxels = dim[0] * dim[1] * dim[2];
+    std::vector<uint32_t> volume(voxels, 0);
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const double noise = trial % 3 == 0 ? 0.55 : 0.0;
+    for (size_t i = 0; i < voxels; ++i) {
+      volume[i] = unit(rng) < noise ? 1 : 2;
+    }
+    for (int ball = 0; ball < 4; ++ball) {
+      const double c[3] = { unit(rng) * dim[0], unit(rng) * dim[1], unit(rng) * dim[2] };
+      const double r = 2.0 + unit(rng) * 8.0;
+      const bool tunnel = ball % 2 == 1;
+      for (size_t z = 0; z < dim[2]; ++z) {
+        for (size_t y = 0; y < dim[1]; ++y) {
+          for (size_t x = 0; x < dim[0]; ++x) {
+            const double dx = x - c[0], dy = y - c[1], dz = z - c[2];
+            const double d = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (d <= r) {
+              const bool shell = d > r - 1.5 && !(tunnel && std::abs(dy) < 1.0 && std::abs(dz) < 1.0 && dx > 0.0);
+              volume[x + dim[0] * (y + dim[1] * z)] = shell ? 1 : 3;
+            }
+          }
+        }
+      }
+    }
+
+    // Reference: BFS over the unselected voxels from the border (the task
+    // border itself is never selected)
+    std::vector<uint32_t> filled(voxels, 1);
+    std::vector<size_t> queue;
+    auto outside = [&](size_t i) {
+      filled[i] = 0;
+      queue.push_back(i);
+    };
+    auto visit = [&](size_t i) {
+      if (volume[i] != 1 && filled[i] == 1) outside(i);
+    };
+    for (size_t z = 0; z < dim[2]; ++z) {
+      for (size_t y = 0; y < dim[1]; ++y) {
+        for (size_t x = 0; x < dim[0]; ++x) {
+          if (x == 0 || y == 0 || z == 0 || x + 1 == dim[0] || y + 1 == dim[1] || z + 1 == dim[2]) {
+            outside(x + dim[0] * (y + dim[1] * z));
+          }
+        }
+      }
+    }
+    for (size_t q = 0; q < queue.size(); ++q) {
+      const size_t i = queue[q];
+      const size_t x = i % dim[0], y = i / dim[0] % dim[1], z = i / (dim[0] * dim[1]);
+      if (x > 0) visit(i - 1);
+      if (x + 1 < dim[0]) visit(i + 1);
+      if (y > 0) visit(i - dim[0]);
+      if (y + 1 < dim[1]) visit(i + dim[0]);
+      if (z > 0) visit(i - dim[0] * dim[1]);
+      if (z + 1 < dim[2]) visit(i + dim[0] * dim[1]);
+    }
+
+    const std::vector<uint32_t> segments(1, 1);
+    CTaskMesherOptions options;
+    options.outputFormats = TASKMESHER_FORMAT_DEGENERATE_STRIP | TASKMESHER_FORMAT_INDEXED;
+    CTaskMesher<uint32_t> reference(filled.data(), dim, segments, 1, options);
+    const CMeshOutput expected = Collect(reference, 1);
+
+    const std::string prefix = "fillHoles trial " + std::to_string(trial) + ": ";
+    options.fillHoles = true;
+    CTaskMesher<uint32_t> inPlace(volume.data(), dim, segments, 1, options);
+    Compare(expected, Collect(inPlace, 1), prefix + "in place");
+
+    const zi::vl::vec<size_t, 3> block(8, 8, 8);
+    const std::vector<uint32_t> words = CompressSegmentation<uint32_t>(volume.data(), dim, block);
+    CTaskMesher<uint32_t> compressed(CCompressedSegmentation(words.data(), words.size(), dim, block), segments, 1, options);
+    Compare(expected, Collect(compressed, 1), prefix + "compressed");
+
+    const CSegmentIndex<uint32_t> index(volume.data(), dim, 8);
+    CTaskMesher<uint32_t> indexed(volume.data(), index, segments, 1, options);
+    Compare(expected, Collect(indexed, 1), prefix + "index");
+
+    // Cavities can cross z-blocks, chunked input rejects the option
+    const CBlockReader<uint32_t> reader = [&](size_t zBegin, size_t, uint32_t *) { return volume.data() + zBegin * dim[0] * dim[1]; };
+    CTaskMesher<uint32_t> chunked(reader, dim, segments, 1, options);
+    Check(chunked.GetStatus() == TASKMESHER_RESULT_UNSUPPORTED, prefix + "chunked input not rejected");
+  }
+}
+
+/*****************************************************************/
+
+int main(int argc, char ** argv) {
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i], value = argv[i + 1];
+    if (arg == "--seed") {
+      seed = std::stoull(value);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  const CTestVolume volumes[] = {
+    { "spheres", 64, 0 }, { "neurites", 64, 0 }, { "fragments", 48, 0 }, { "checkerboard", 24, 0 }, { "stack", 64, 16 }
+  };
+  for (const CTestVolume & v : volumes) {
+    TestInputPaths<uint32_t>(v, "uint32", seed);
+  }
+  TestInputPaths<uint8_t>(volumes[0], "uint8", seed);
+  TestInputPaths<uint16_t>(volumes[4], "uint16", seed);
+  TestCropping(seed);
+  TestFillHoles(seed);
+
+  printf("%d of %d checks failed\n", failures, checks);
+  return failures > 0 ? 1 : 0;
+}